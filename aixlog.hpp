@@ -32,8 +32,10 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <ctime>
 #include <fstream>
@@ -93,11 +95,22 @@
 #define AIXLOG_INTERNAL__LOG_MACRO_CHOOSER(...) AIXLOG_INTERNAL__VAR_PARM(__VA_ARGS__, AIXLOG_INTERNAL__LOG_SEVERITY_TAG, AIXLOG_INTERNAL__LOG_SEVERITY, )
 #define AIXLOG_INTERNAL__COLOR_MACRO_CHOOSER(...) AIXLOG_INTERNAL__VAR_PARM(__VA_ARGS__, AIXLOG_INTERNAL__TWO_COLOR, AIXLOG_INTERNAL__ONE_COLOR, )
 
+/// Minimum severity that is compiled in, lower severities are removed by the compiler (0: TRACE .. 6: FATAL)
+#ifndef AIXLOG_MIN_SEVERITY
+#define AIXLOG_MIN_SEVERITY 0
+#endif
+
+#define AIXLOG_INTERNAL__FIRST(FIRST_, ...) FIRST_
+/// Disabled severities skip the formatting and locking of the log line. The LOG macro is a single expression, so that
+/// it can be used in unbraced if/else statements.
+#define AIXLOG_INTERNAL__ENABLED(...) AixLog::Log::enabled(static_cast<AixLog::Severity>(AIXLOG_INTERNAL__FIRST(__VA_ARGS__, )))
+
 /// External logger macros
 // usage: LOG(SEVERITY) or LOG(SEVERITY, TAG)
 // e.g.: LOG(NOTICE) or LOG(NOTICE, "my tag")
 #ifndef WIN32
-#define LOG(...) AIXLOG_INTERNAL__LOG_MACRO_CHOOSER(__VA_ARGS__)(__VA_ARGS__) << TIMESTAMP << FUNC
+#define LOG(...)                                                                                                                                               \
+    !AIXLOG_INTERNAL__ENABLED(__VA_ARGS__) ? (void)0 : AixLog::Voidify() & AIXLOG_INTERNAL__LOG_MACRO_CHOOSER(__VA_ARGS__)(__VA_ARGS__) << TIMESTAMP << FUNC
 #endif
 
 // usage: COLOR(TEXT_COLOR, BACKGROUND_COLOR) or COLOR(TEXT_COLOR)
@@ -448,6 +461,18 @@ private:
     bool is_null_;
 };
 
+/**
+ * @brief
+ * Turns the stream of an enabled log line into void, for the conditional expression of the LOG macro
+ * "&" binds weaker than "<<" and stronger than "?:"
+ */
+struct Voidify
+{
+    void operator&(const std::ostream& /*stream*/) const
+    {
+    }
+};
+
 /**
  * @brief
  * Collection of a log line's meta data
@@ -493,6 +518,18 @@ public:
         return false;
     }
 
+    /// @return the lowest severity that can match any tag
+    Severity min_severity() const
+    {
+        if (tag_filter_.empty())
+            return Severity::trace;
+
+        auto result = Severity::fatal;
+        for (const auto& filter : tag_filter_)
+            result = std::min(result, filter.second);
+        return result;
+    }
+
     void add_filter(const Tag& tag, Severity severity)
     {
         tag_filter_[tag] = severity;
@@ -564,10 +601,18 @@ public:
         return instance_;
     }
 
+    /// @return true if a log line with @p severity might be logged by any sink. Cheap enough for hot paths.
+    static bool enabled(Severity severity) noexcept
+    {
+        return (static_cast<int>(severity) >= AIXLOG_MIN_SEVERITY) && (static_cast<std::int8_t>(severity) >= min_severity_.load(std::memory_order_relaxed));
+    }
+
     /// Without "init" every LOG(X) will simply go to clog
     static void init(const std::vector<log_sink_ptr>& log_sinks = {})
     {
+        std::lock_guard<std::recursive_mutex> lock(Log::instance().mutex_);
         Log::instance().log_sinks_.clear();
+        Log::instance().update_min_severity();
 
         for (const auto& sink : log_sinks)
             Log::instance().add_logsink(sink);
@@ -588,6 +633,7 @@ public:
         static_assert(std::is_base_of<Sink, typename std::decay<T>::type>::value, "type T must be a Sink");
         std::shared_ptr<T> sink = std::make_shared<T>(std::forward<Ts>(params)...);
         log_sinks_.push_back(sink);
+        update_min_severity();
         return sink;
     }
 
@@ -595,12 +641,25 @@ public:
     {
         std::lock_guard<std::recursive_mutex> lock(mutex_);
         log_sinks_.push_back(sink);
+        update_min_severity();
     }
 
     void remove_logsink(const log_sink_ptr& sink)
     {
         std::lock_guard<std::recursive_mutex> lock(mutex_);
         log_sinks_.erase(std::remove(log_sinks_.begin(), log_sinks_.end(), sink), log_sinks_.end());
+        update_min_severity();
+    }
+
+    /// Must be called after changing the filter of an added sink
+    void update_min_severity()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        // one above fatal: nothing is logged without sinks
+        auto result = static_cast<int>(Severity::fatal) + 1;
+        for (const auto& sink : log_sinks_)
+            result = std::min(result, static_cast<int>(sink->filter.min_severity()));
+        min_severity_ = static_cast<std::int8_t>(result);
     }
 
 protected:
@@ -680,6 +739,8 @@ private:
     bool do_log_;
     std::vector<log_sink_ptr> log_sinks_;
     std::recursive_mutex mutex_;
+    /// lowest severity of all sinks' filters, everything goes to clog before "init"
+    static inline std::atomic<std::int8_t> min_severity_{static_cast<std::int8_t>(Severity::trace)};
 };
 
 /**
@@ -1130,6 +1191,152 @@ private:
     callback_fun callback_;
 };
 
+/**
+ * @brief
+ * Forward log messages asynchronously to another sink
+ *
+ * Log messages are pushed into a bounded lock-free queue and written by a background thread, so that logging never
+ * blocks on file or syslog I/O. Messages are dropped if the queue is full, the number of dropped messages is logged
+ * by the background thread.
+ */
+struct SinkAsync : public Sink
+{
+    /// @param sink the sink that writes the messages, its filter is not applied
+    /// @param capacity number of queued messages, rounded up to a power of two
+    SinkAsync(const Filter& filter, log_sink_ptr sink, size_t capacity = 1024) : Sink(filter), log_sink_(std::move(sink))
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        cells_ = std::vector<Cell>(size);
+        for (size_t n = 0; n < size; ++n)
+            cells_[n].sequence = n;
+        mask_ = size - 1;
+        thread_ = std::thread(&SinkAsync::worker, this);
+    }
+
+    ~SinkAsync() override
+    {
+        {
+            // Under the mutex, so that the worker can't miss the notification between its check and its wait
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_ = false;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    /// Enqueue the message, never blocks
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        // Bounded MPSC queue, based on Dmitry Vyukov's bounded MPMC queue
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;)
+        {
+            cell = &cells_[pos & mask_];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                // full
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        // Assigning reuses the capacity of the cell's previous message
+        cell->metadata = metadata;
+        cell->message = message;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        if (waiting_.load(std::memory_order_acquire))
+            cv_.notify_one();
+    }
+
+    /// @return number of messages dropped because the queue was full
+    size_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+protected:
+    struct Cell
+    {
+        std::atomic<size_t> sequence{0};
+        Metadata metadata;
+        std::string message;
+    };
+
+    /// Write the next queued message
+    /// @return false if the queue is empty
+    bool write_next()
+    {
+        Cell& cell = cells_[dequeue_pos_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+            return false;
+        log_sink_->log(cell.metadata, cell.message);
+        cell.sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+        return true;
+    }
+
+    void worker()
+    {
+        size_t reported = 0;
+        while (true)
+        {
+            while (write_next())
+                ;
+
+            size_t dropped = dropped_.load(std::memory_order_relaxed);
+            if (dropped != reported)
+            {
+                Metadata metadata;
+                metadata.severity = Severity::warning;
+                metadata.tag = "SinkAsync";
+                metadata.timestamp = std::chrono::system_clock::now();
+                log_sink_->log(metadata, "Dropped " + std::to_string(dropped - reported) + " log messages");
+                reported = dropped;
+            }
+
+            // A notification of log() that is lost between the check and the wait delays the message by the timeout
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!active_)
+                break;
+            waiting_ = true;
+            if (!write_next())
+                cv_.wait_for(lock, std::chrono::milliseconds(100));
+            waiting_ = false;
+        }
+
+        // Messages that were logged after the last write, before the destructor
+        while (write_next())
+            ;
+    }
+
+    log_sink_ptr log_sink_;
+    std::vector<Cell> cells_;
+    size_t mask_;
+    std::atomic<size_t> enqueue_pos_{0};
+    /// only accessed by the worker thread
+    size_t dequeue_pos_ = 0;
+    std::atomic<size_t> dropped_{0};
+    std::atomic<bool> active_{true};
+    std::atomic<bool> waiting_{false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+};
+
 /**
  * @brief
  * ostream << operator for "Severity"
@@ -0,0 +1,323 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "audio_packing.hpp"
+
+// local headers
+#include "protocol.hpp"
+#include "simd.hpp"
+
+// standard headers
+#include <array>
+#include <cstring>
+
+
+namespace packing
+{
+
+namespace
+{
+
+/// @return true if all channels of the @p frames in @p samples are identical
+template <typename T>
+SIMD_INLINE bool isMono(const T* samples, size_t frames, uint16_t channels)
+{
+    // The differences are accumulated instead of returning early, so that the loops vectorize
+    uint32_t diff = 0;
+    if (channels == 2)
+    {
+        for (size_t n = 0; n < frames; ++n)
+            diff |= static_cast<uint32_t>(samples[2 * n] ^ samples[2 * n + 1]);
+    }
+    else
+    {
+        for (size_t n = 0; n < frames; ++n)
+            for (uint16_t c = 1; c < channels; ++c)
+                diff |= static_cast<uint32_t>(samples[n * channels + c] ^ samples[n * channels]);
+    }
+    return diff == 0;
+}
+
+
+/// @return true if all channels of the @p frames in 3 byte @p samples are identical
+SIMD_INLINE bool isMono(const Packed24* samples, size_t frames, uint16_t channels)
+{
+    // Compared byte by byte, with the byte at the same position in the first channel
+    const auto* bytes = reinterpret_cast<const uint8_t*>(samples);
+    size_t frame_size = channels * sizeof(Packed24);
+    uint32_t diff = 0;
+    for (size_t n = 0; n < frames; ++n)
+        for (size_t b = sizeof(Packed24); b < frame_size; ++b)
+            diff |= static_cast<uint32_t>(bytes[n * frame_size + b] ^ bytes[n * frame_size + b % sizeof(Packed24)]);
+    return diff == 0;
+}
+
+
+/// @return @p value, whose lower @p shift bits are zero, from its upper 16 significant bits
+SIMD_INLINE uint32_t widen(int16_t value, unsigned shift)
+{
+    return static_cast<uint32_t>(static_cast<int32_t>(value)) << shift;
+}
+
+
+/// @return true if the @p count @p samples survive the round trip through their upper 16 significant bits
+SIMD_INLINE bool fitsWidth16(const int32_t* samples, size_t count, unsigned shift)
+{
+    uint32_t diff = 0;
+    for (size_t n = 0; n < count; ++n)
+    {
+        auto value = static_cast<uint32_t>(samples[n]);
+        diff |= value ^ widen(static_cast<int16_t>(value >> shift), shift);
+    }
+    return diff == 0;
+}
+
+
+/// Bits below the upper 16 significant bits of a sample, 0 if the format can't be reduced in width
+SIMD_INLINE unsigned widthShift(const SampleFormat& format)
+{
+    return (format.sampleSize() == 4) ? format.bits() - 16u : 0u;
+}
+
+
+/// Copy the first channel of each of the @p frames in @p in to @p out
+template <typename T>
+SIMD_INLINE void packMono(const T* in, size_t frames, uint16_t channels, T* out)
+{
+    for (size_t n = 0; n < frames; ++n)
+        out[n] = in[n * channels];
+}
+
+
+/// Duplicate each of the @p frames in @p in into all @p channels of @p out
+template <typename T>
+SIMD_INLINE void unpackMono(const T* in, size_t frames, uint16_t channels, T* out)
+{
+    for (size_t n = 0; n < frames; ++n)
+        for (uint16_t c = 0; c < channels; ++c)
+            out[n * channels + c] = in[n];
+}
+
+
+/// analyze(), inlined into the kernel of each SimdLevel
+SIMD_INLINE uint16_t analyzeSamples(const void* data, size_t size, const SampleFormat& format)
+{
+    auto frames = size / format.frameSize();
+    uint16_t flags = 0;
+    switch (format.sampleSize())
+    {
+        case 1:
+            flags |= isMono(static_cast<const int8_t*>(data), frames, format.channels()) ? msg::kFlagMono : 0;
+            break;
+        case 2:
+            flags |= isMono(static_cast<const int16_t*>(data), frames, format.channels()) ? msg::kFlagMono : 0;
+            break;
+        case 3:
+            flags |= isMono(static_cast<const Packed24*>(data), frames, format.channels()) ? msg::kFlagMono : 0;
+            break;
+        case 4:
+        {
+            const auto* samples = static_cast<const int32_t*>(data);
+            flags |= isMono(samples, frames, format.channels()) ? msg::kFlagMono : 0;
+            flags |= fitsWidth16(samples, frames * format.channels(), widthShift(format)) ? msg::kFlagWidth16 : 0;
+            break;
+        }
+        default:
+            break;
+    }
+    // Mono audio has nothing to gain with a single channel
+    if (format.channels() < 2)
+        flags &= ~msg::kFlagMono;
+    return flags;
+}
+
+
+/// pack(), inlined into the kernel of each SimdLevel
+SIMD_INLINE void packSamples(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    auto frames = size / format.frameSize();
+    uint16_t channels = format.channels();
+    if ((flags & msg::kFlagWidth16) == 0)
+    {
+        if ((flags & msg::kFlagMono) == 0)
+            memcpy(out, data, size);
+        else if (format.sampleSize() == 1)
+            packMono(static_cast<const int8_t*>(data), frames, channels, static_cast<int8_t*>(out));
+        else if (format.sampleSize() == 2)
+            packMono(static_cast<const int16_t*>(data), frames, channels, static_cast<int16_t*>(out));
+        else if (format.sampleSize() == 3)
+            packMono(static_cast<const Packed24*>(data), frames, channels, static_cast<Packed24*>(out));
+        else
+            packMono(static_cast<const int32_t*>(data), frames, channels, static_cast<int32_t*>(out));
+        return;
+    }
+
+    const auto* in = static_cast<const int32_t*>(data);
+    auto* samples = static_cast<int16_t*>(out);
+    auto shift = widthShift(format);
+    // Pick every channels'th sample for mono
+    size_t step = ((flags & msg::kFlagMono) != 0) ? channels : 1;
+    size_t count = frames * channels / step;
+    for (size_t n = 0; n < count; ++n)
+        samples[n] = static_cast<int16_t>(static_cast<uint32_t>(in[n * step]) >> shift);
+}
+
+
+/// unpack(), inlined into the kernel of each SimdLevel
+SIMD_INLINE void unpackSamples(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    uint16_t channels = format.channels();
+    if ((flags & msg::kFlagWidth16) == 0)
+    {
+        auto frames = size / format.sampleSize();
+        if ((flags & msg::kFlagMono) == 0)
+            memcpy(out, data, size);
+        else if (format.sampleSize() == 1)
+            unpackMono(static_cast<const int8_t*>(data), frames, channels, static_cast<int8_t*>(out));
+        else if (format.sampleSize() == 2)
+            unpackMono(static_cast<const int16_t*>(data), frames, channels, static_cast<int16_t*>(out));
+        else if (format.sampleSize() == 3)
+            unpackMono(static_cast<const Packed24*>(data), frames, channels, static_cast<Packed24*>(out));
+        else
+            unpackMono(static_cast<const int32_t*>(data), frames, channels, static_cast<int32_t*>(out));
+        return;
+    }
+
+    const auto* in = static_cast<const int16_t*>(data);
+    auto* samples = static_cast<int32_t*>(out);
+    auto shift = widthShift(format);
+    size_t count = size / sizeof(int16_t);
+    if ((flags & msg::kFlagMono) == 0)
+    {
+        for (size_t n = 0; n < count; ++n)
+            samples[n] = static_cast<int32_t>(widen(in[n], shift));
+        return;
+    }
+    for (size_t n = 0; n < count; ++n)
+    {
+        auto value = static_cast<int32_t>(widen(in[n], shift));
+        for (uint16_t c = 0; c < channels; ++c)
+            samples[n * channels + c] = value;
+    }
+}
+
+
+/// The kernels of analyze(), pack() and unpack() for each SimdLevel
+uint16_t analyzeGeneric(const void* data, size_t size, const SampleFormat& format)
+{
+    return analyzeSamples(data, size, format);
+}
+
+SIMD_TARGET_AVX2 uint16_t analyzeAvx2(const void* data, size_t size, const SampleFormat& format)
+{
+    return analyzeSamples(data, size, format);
+}
+
+SIMD_TARGET_AVX512 uint16_t analyzeAvx512(const void* data, size_t size, const SampleFormat& format)
+{
+    return analyzeSamples(data, size, format);
+}
+
+void packGeneric(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    packSamples(data, size, format, flags, out);
+}
+
+SIMD_TARGET_AVX2 void packAvx2(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    packSamples(data, size, format, flags, out);
+}
+
+SIMD_TARGET_AVX512 void packAvx512(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    packSamples(data, size, format, flags, out);
+}
+
+void unpackGeneric(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    unpackSamples(data, size, format, flags, out);
+}
+
+SIMD_TARGET_AVX2 void unpackAvx2(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    unpackSamples(data, size, format, flags, out);
+}
+
+SIMD_TARGET_AVX512 void unpackAvx512(const void* data, size_t size, const SampleFormat& format, uint16_t flags,
+                                     void* out)
+{
+    unpackSamples(data, size, format, flags, out);
+}
+
+
+/// @return the kernel out of @p kernels for simd::active()
+template <typename Kernel>
+Kernel select(const std::array<Kernel, kSimdLevels>& kernels)
+{
+    return kernels[static_cast<size_t>(simd::active())];
+}
+
+} // namespace
+
+
+
+
+size_t packedSize(size_t size, const SampleFormat& format, uint16_t flags)
+{
+    if ((flags & msg::kFlagMono) != 0)
+        size /= format.channels();
+    if ((flags & msg::kFlagWidth16) != 0)
+        size /= 2;
+    return size;
+}
+
+
+size_t unpackedSize(size_t size, const SampleFormat& format, uint16_t flags)
+{
+    if ((flags & msg::kFlagMono) != 0)
+        size *= format.channels();
+    if ((flags & msg::kFlagWidth16) != 0)
+        size *= 2;
+    return size;
+}
+
+
+uint16_t analyze(const void* data, size_t size, const SampleFormat& format)
+{
+    static constexpr std::array<decltype(&analyzeGeneric), kSimdLevels> kernels{analyzeGeneric, analyzeAvx2,
+                                                                                 analyzeAvx512};
+    return select(kernels)(data, size, format);
+}
+
+
+void pack(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    static constexpr std::array<decltype(&packGeneric), kSimdLevels> kernels{packGeneric, packAvx2, packAvx512};
+    select(kernels)(data, size, format, flags, out);
+}
+
+
+void unpack(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out)
+{
+    static constexpr std::array<decltype(&unpackGeneric), kSimdLevels> kernels{unpackGeneric, unpackAvx2,
+                                                                                 unpackAvx512};
+    select(kernels)(data, size, format, flags, out);
+}
+
+} // namespace packing
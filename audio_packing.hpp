@@ -0,0 +1,50 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// local headers
+#include "sample_format.hpp"
+
+// standard headers
+#include <cstddef>
+#include <cstdint>
+
+
+/// Lossless packing of audio messages, see msg::kFlagMono and msg::kFlagWidth16
+///
+/// Mono content that is duplicated into all channels is sent as one channel, 16 bit content in 24 or 32 bit samples
+/// is sent as 16 bit samples. The analysis is a branch free pass over the chunk, that the compiler vectorizes.
+namespace packing
+{
+
+/// @return the audio flags under which @p size bytes of @p data in @p format can be packed losslessly
+uint16_t analyze(const void* data, size_t size, const SampleFormat& format);
+
+/// @return size in bytes of @p size bytes of audio in @p format, after packing with @p flags
+size_t packedSize(size_t size, const SampleFormat& format, uint16_t flags);
+/// @return size in bytes of @p size bytes of audio that were packed with @p flags, after unpacking to @p format
+size_t unpackedSize(size_t size, const SampleFormat& format, uint16_t flags);
+
+/// Pack @p size bytes of @p data in @p format with @p flags into @p out, which holds packedSize() bytes
+void pack(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out);
+/// Unpack @p size bytes of @p data that were packed with @p flags into @p out in @p format, which holds
+/// unpackedSize() bytes
+void unpack(const void* data, size_t size, const SampleFormat& format, uint16_t flags, void* out);
+
+} // namespace packing
@@ -0,0 +1,365 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// local headers
+#include "aixlog.hpp"
+#include "audio_packing.hpp"
+#include "channel_mixer.hpp"
+#include "jitter_buffer.hpp"
+#include "sample_format.hpp"
+#include "simd.hpp"
+#include "snapstream.hpp"
+#include "uri.hpp"
+
+// 3rd party headers
+#include <benchmark/benchmark.h>
+#include <boost/asio.hpp>
+
+// standard headers
+#include <array>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+/// Log only warnings and errors of the components, so that the benchmark output stays readable
+void initLog()
+{
+    AixLog::Log::init<AixLog::SinkCerr>(AixLog::Severity::warning);
+}
+
+
+/// The SimdLevels, as benchmark arguments
+const std::vector<int64_t> kLevels{static_cast<int>(SimdLevel::generic), static_cast<int>(SimdLevel::avx2),
+                                   static_cast<int>(SimdLevel::avx512)};
+
+
+/// Select the kernels of the SimdLevel in argument @p arg, after checking that they produce the same output as the
+/// generic kernels: @p run is called once for each level and returns the output of freshly selected kernels.
+/// simd::reset() restores the selection after the benchmark.
+/// @return false if the benchmark is skipped, because the CPU lacks the level or the outputs differ
+template <typename Run>
+bool selectSimd(benchmark::State& state, int arg, Run run)
+{
+    auto level = static_cast<SimdLevel>(state.range(arg));
+    simd::force(SimdLevel::generic);
+    auto reference = run();
+    if (simd::force(level) != level)
+    {
+        simd::reset();
+        state.SkipWithError("The CPU doesn't support the simd level");
+        return false;
+    }
+    if (run() != reference)
+    {
+        simd::reset();
+        state.SkipWithError("The output differs from the generic kernels");
+        return false;
+    }
+    return true;
+}
+
+
+/// Mixing and converting a period of interleaved 16 bit audio
+/// Arguments: frames, client channels (2: stereo with volume, 6: 5.1 downmix), SimdLevel
+void BM_ChannelMixer(benchmark::State& state)
+{
+    auto frames = static_cast<size_t>(state.range(0));
+    auto channels = static_cast<uint16_t>(state.range(1));
+    auto configure = [&](ChannelMixer& mixer)
+    {
+        mixer.configure(SampleEncoding::s16le, ChannelMixer::defaultLayout(channels), SampleEncoding::s16le,
+                        ChannelMixer::defaultLayout(2));
+        // A gain requantizes the samples, even for stereo
+        mixer.setGain(0.5f);
+    };
+
+    std::vector<int16_t> source(frames * channels);
+    for (size_t n = 0; n < source.size(); ++n)
+        source[n] = static_cast<int16_t>(n * 31);
+    std::vector<int16_t> destination(frames * 2);
+    std::array<ChannelArea, 8> areas;
+    for (uint16_t c = 0; c < channels; ++c)
+        areas[c] = {source.data() + c, channels};
+
+    auto run = [&]()
+    {
+        ChannelMixer mixer;
+        configure(mixer);
+        mixer.mix(areas.data(), destination.data(), frames);
+        return destination;
+    };
+    if (!selectSimd(state, 2, run))
+        return;
+    ChannelMixer mixer;
+    configure(mixer);
+
+    for (auto _ : state)
+    {
+        mixer.mix(areas.data(), destination.data(), frames);
+        benchmark::DoNotOptimize(destination.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * frames));
+    simd::reset();
+}
+BENCHMARK(BM_ChannelMixer)->ArgsProduct({{256, 1024, 4096}, {2, 6}, kLevels});
+
+
+/// Converting a period of interleaved stereo between sample encodings, without mixing
+/// Arguments: source encoding, destination encoding (see SampleEncoding), SimdLevel
+void BM_SampleConversion(benchmark::State& state)
+{
+    constexpr size_t frames = 1024;
+    auto source = static_cast<SampleEncoding>(state.range(0));
+    auto destination = static_cast<SampleEncoding>(state.range(1));
+
+    // Random samples, floats slightly beyond full scale to cover the clipping
+    std::vector<char> in(frames * 2 * sampleSize(source));
+    std::mt19937 random(1);
+    if (source == SampleEncoding::f32le)
+    {
+        std::uniform_real_distribution<float> distribution(-1.1f, 1.1f);
+        for (size_t n = 0; n < frames * 2; ++n)
+            reinterpret_cast<float*>(in.data())[n] = distribution(random);
+    }
+    else
+    {
+        for (auto& byte : in)
+            byte = static_cast<char>(random());
+    }
+    std::vector<char> out(frames * 2 * sampleSize(destination));
+    std::array<ChannelArea, 2> areas{{{in.data(), 2}, {in.data() + sampleSize(source), 2}}};
+
+    auto run = [&]()
+    {
+        ChannelMixer mixer;
+        mixer.configure(source, ChannelMixer::defaultLayout(2), destination, ChannelMixer::defaultLayout(2));
+        mixer.mix(areas.data(), out.data(), frames);
+        return out;
+    };
+    if (!selectSimd(state, 2, run))
+        return;
+    ChannelMixer mixer;
+    mixer.configure(source, ChannelMixer::defaultLayout(2), destination, ChannelMixer::defaultLayout(2));
+
+    for (auto _ : state)
+    {
+        mixer.mix(areas.data(), out.data(), frames);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * frames));
+    simd::reset();
+}
+BENCHMARK(BM_SampleConversion)
+    ->ArgsProduct({{static_cast<int>(SampleEncoding::f32le)}, {static_cast<int>(SampleEncoding::s16le)}, kLevels})
+    ->ArgsProduct({{static_cast<int>(SampleEncoding::s32le)}, {static_cast<int>(SampleEncoding::s24_3le)}, kLevels})
+    ->ArgsProduct({{static_cast<int>(SampleEncoding::s24_3le)}, {static_cast<int>(SampleEncoding::s16le)}, kLevels})
+    ->ArgsProduct({{static_cast<int>(SampleEncoding::s16le)}, {static_cast<int>(SampleEncoding::f32le)}, kLevels});
+
+
+/// Pushing a period into the jitter buffer and popping it again
+void BM_JitterBuffer(benchmark::State& state)
+{
+    auto frames = static_cast<size_t>(state.range(0));
+    SampleFormat format("48000:16:2");
+    JitterBuffer jitter(format, 0ms, 500ms);
+    std::vector<char> period(frames * format.frameSize());
+
+    for (auto _ : state)
+    {
+        jitter.write(period.data(), period.size());
+        benchmark::DoNotOptimize(jitter.read(period.data(), frames, 0us));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * period.size()));
+}
+BENCHMARK(BM_JitterBuffer)->Arg(256)->Arg(1024)->Arg(4096);
+
+
+/// Analyzing and packing a period of mono content in stereo, the worst case of the analysis is unpackable content
+/// Arguments: frames, bits (16: mono packing, 32: mono and width packing), SimdLevel
+void BM_AudioPacking(benchmark::State& state)
+{
+    auto frames = static_cast<size_t>(state.range(0));
+    SampleFormat format("48000:" + std::to_string(state.range(1)) + ":2");
+    std::vector<char> period(frames * format.frameSize());
+    for (size_t n = 0; n < frames; ++n)
+    {
+        // Both channels of a frame get the same 16 significant bits
+        auto value = static_cast<int16_t>(n * 31);
+        for (size_t c = 0; c < 2; ++c)
+        {
+            if (format.sampleSize() == 2)
+                reinterpret_cast<int16_t*>(period.data())[2 * n + c] = value;
+            else
+                reinterpret_cast<int32_t*>(period.data())[2 * n + c] = static_cast<int32_t>(value) * 65536;
+        }
+    }
+    std::vector<char> packed(period.size());
+
+    auto run = [&]()
+    {
+        auto flags = packing::analyze(period.data(), period.size(), format);
+        packing::pack(period.data(), period.size(), format, flags, packed.data());
+        return std::vector<char>(packed.begin(), packed.begin() + packing::packedSize(period.size(), format, flags));
+    };
+    if (!selectSimd(state, 2, run))
+        return;
+
+    for (auto _ : state)
+    {
+        auto flags = packing::analyze(period.data(), period.size(), format);
+        packing::pack(period.data(), period.size(), format, flags, packed.data());
+        benchmark::DoNotOptimize(packed.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * period.size()));
+    simd::reset();
+}
+BENCHMARK(BM_AudioPacking)->ArgsProduct({{256, 1024, 4096}, {16, 32}, kLevels});
+
+
+/// Local TCP server that discards everything it receives
+class DiscardServer
+{
+public:
+    DiscardServer() : acceptor_(io_context_, {boost::asio::ip::make_address("127.0.0.1"), 0}), socket_(io_context_)
+    {
+        acceptor_.async_accept(socket_, [this](const boost::system::error_code& ec)
+        {
+            if (!ec)
+                read();
+        });
+        thread_ = std::thread([this]() { io_context_.run(); });
+    }
+
+    ~DiscardServer()
+    {
+        io_context_.stop();
+        thread_.join();
+    }
+
+    uint16_t port() const
+    {
+        return acceptor_.local_endpoint().port();
+    }
+
+private:
+    void read()
+    {
+        socket_.async_read_some(boost::asio::buffer(buffer_), [this](const boost::system::error_code& ec, size_t)
+        {
+            if (!ec)
+                read();
+        });
+    }
+
+    boost::asio::io_context io_context_;
+    tcp::acceptor acceptor_;
+    tcp::socket socket_;
+    std::array<char, 64 * 1024> buffer_;
+    std::thread thread_;
+};
+
+
+/// Queueing a period with SnapStream::write, while the stream is sending to a local server
+void BM_SnapStreamWrite(benchmark::State& state)
+{
+    auto bytes = static_cast<uint32_t>(state.range(0));
+    DiscardServer server;
+    SnapStream stream(Uri("tcp://127.0.0.1:" + std::to_string(server.port())), Protocol::snapstream);
+    stream.reserve(64, bytes, false);
+    stream.start();
+    auto stats = stream.stats();
+    auto deadline = std::chrono::steady_clock::now() + 2s;
+    while (!stats->connected && (std::chrono::steady_clock::now() < deadline))
+        std::this_thread::sleep_for(1ms);
+    if (!stats->connected)
+    {
+        state.SkipWithError("Failed to connect");
+        return;
+    }
+
+    std::vector<char> period(bytes);
+    for (auto _ : state)
+        stream.write(period.data(), bytes);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    stream.stop();
+}
+BENCHMARK(BM_SnapStreamWrite)->Arg(1024)->Arg(4096)->Arg(16384)->UseRealTime();
+
+
+/// A log line whose severity is filtered out
+void BM_LogDisabled(benchmark::State& state)
+{
+    AixLog::Log::init<AixLog::SinkCallback>(AixLog::Filter(AixLog::Severity::info),
+                                            [](const AixLog::Metadata&, const std::string&) {});
+    int64_t n = 0;
+    for (auto _ : state)
+        LOG(DEBUG, "Benchmark") << "Transfer, offset: " << n++ << ", size: " << 1024 << "\n";
+    initLog();
+}
+BENCHMARK(BM_LogDisabled);
+
+
+/// A log line that is passed to a sink, for comparison with BM_LogDisabled
+void BM_LogEnabled(benchmark::State& state)
+{
+    AixLog::Log::init<AixLog::SinkCallback>(AixLog::Filter(AixLog::Severity::debug),
+                                            [](const AixLog::Metadata&, const std::string&) {});
+    int64_t n = 0;
+    for (auto _ : state)
+        LOG(DEBUG, "Benchmark") << "Transfer, offset: " << n++ << ", size: " << 1024 << "\n";
+    initLog();
+}
+BENCHMARK(BM_LogEnabled);
+
+
+void BM_UriParse(benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Uri("tcp://snapserver.local:4953/stream?name=living%20room"));
+}
+BENCHMARK(BM_UriParse);
+
+
+void BM_SampleFormatParse(benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(SampleFormat("48000:24:2"));
+}
+BENCHMARK(BM_SampleFormatParse);
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    initLog();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,469 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/// Load test: many streams, paced like the plugin's Transfer, sending to an in-process snapserver stand-in
+///
+/// The sink verifies the byte count and the content of every stream and measures the inter-arrival jitter of the
+/// periods. The report answers how many streams a core can serve and how much jitter they see meanwhile.
+
+// local headers
+#include "aixlog.hpp"
+#include "channel_mixer.hpp"
+#include "histogram.hpp"
+#include "protocol.hpp"
+#include "sample_format.hpp"
+#include "snapstream.hpp"
+
+// 3rd party headers
+#include <boost/asio.hpp>
+
+// standard headers
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+struct Options
+{
+    size_t streams = 8;
+    size_t period = 1024;
+    SampleFormat format{"48000:16:2"};
+    seconds duration{10};
+    Protocol protocol = Protocol::snapstream;
+    /// gain != 1 exercises the mixer, but disables the content check
+    float gain = 1.f;
+};
+
+
+/// Sample @p index of the stream with @p key, the pattern is checked by the sink
+inline uint16_t pattern(uint16_t key, uint64_t index)
+{
+    return static_cast<uint16_t>(index) ^ key;
+}
+
+
+/// Received side of a stream
+struct Connection
+{
+    explicit Connection(boost::asio::io_context& io_context) : socket(io_context)
+    {
+    }
+
+    tcp::socket socket;
+    std::array<char, 64 * 1024> buffer;
+    /// unparsed bytes of the snapstream protocol
+    std::vector<char> pending;
+    /// key of the stream, taken from its first sample
+    std::optional<uint16_t> key;
+    uint64_t bytes = 0;
+    uint64_t mismatches = 0;
+    /// odd byte of a sample that was split between two reads
+    std::optional<uint8_t> odd;
+    std::optional<steady_clock::time_point> last_period;
+};
+
+
+/// snapserver stand-in: accepts the streams, verifies their content and measures their inter-arrival jitter
+class Sink
+{
+public:
+    Sink(const Options& options) : options_(options), acceptor_(io_context_, {boost::asio::ip::make_address("127.0.0.1"), 0})
+    {
+        period_bytes_ = options_.period * options_.format.frameSize();
+        period_ = duration_cast<microseconds>(duration<double>(static_cast<double>(options_.period) / options_.format.rate()));
+        accept();
+        thread_ = std::thread(
+            [this]()
+        {
+            io_context_.run();
+            timespec cpu{};
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+            cpu_time_ = seconds(cpu.tv_sec) + nanoseconds(cpu.tv_nsec);
+        });
+    }
+
+    ~Sink()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        if (!thread_.joinable())
+            return;
+        io_context_.stop();
+        thread_.join();
+    }
+
+    uint16_t port() const
+    {
+        return acceptor_.local_endpoint().port();
+    }
+
+    /// @return the received streams, valid after stop()
+    const std::vector<std::shared_ptr<Connection>>& connections() const
+    {
+        return connections_;
+    }
+
+    /// @return deviation of the period inter-arrival times from the period duration, in µs
+    const Histogram& jitter() const
+    {
+        return jitter_;
+    }
+
+    /// @return CPU time of the sink's thread, valid after stop()
+    nanoseconds cpuTime() const
+    {
+        return cpu_time_;
+    }
+
+private:
+    void accept()
+    {
+        auto connection = std::make_shared<Connection>(io_context_);
+        acceptor_.async_accept(connection->socket, [this, connection](const boost::system::error_code& ec)
+        {
+            if (ec)
+                return;
+            connections_.push_back(connection);
+            read(*connection);
+            accept();
+        });
+    }
+
+    void read(Connection& connection)
+    {
+        connection.socket.async_read_some(boost::asio::buffer(connection.buffer),
+                                          [this, &connection](const boost::system::error_code& ec, size_t length)
+        {
+            if (ec)
+                return;
+            if (options_.protocol == Protocol::raw)
+            {
+                audio(connection, connection.buffer.data(), length);
+            }
+            else
+            {
+                auto& pending = connection.pending;
+                pending.insert(pending.end(), connection.buffer.begin(), connection.buffer.begin() + length);
+                size_t pos = 0;
+                msg::Header header;
+                while (pending.size() - pos >= sizeof(header))
+                {
+                    memcpy(&header, pending.data() + pos, sizeof(header));
+                    if (pending.size() - pos - sizeof(header) < header.size)
+                        break;
+                    if (header.type == static_cast<uint16_t>(msg::Type::audio))
+                        audio(connection, pending.data() + pos + sizeof(header), header.size);
+                    pos += sizeof(header) + header.size;
+                }
+                pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(pos));
+            }
+            read(connection);
+        });
+    }
+
+    /// Verify and count @p size bytes of received audio
+    void audio(Connection& connection, const char* data, size_t size)
+    {
+        auto now = steady_clock::now();
+        uint64_t before = connection.bytes;
+        connection.bytes += size;
+
+        // A period is complete when its last byte arrived
+        if (before / period_bytes_ != connection.bytes / period_bytes_)
+        {
+            if (connection.last_period.has_value())
+            {
+                auto interval = duration_cast<microseconds>(now - *connection.last_period);
+                jitter_.record(interval > period_ ? interval - period_ : period_ - interval);
+            }
+            connection.last_period = now;
+        }
+
+        if (options_.gain != 1.f)
+            return;
+        // 16 bit little endian samples, a sample might be split between two chunks
+        uint64_t index = before / 2;
+        size_t pos = 0;
+        if (connection.odd.has_value())
+        {
+            check(connection, index++, static_cast<uint16_t>(*connection.odd | (static_cast<uint8_t>(data[0]) << 8)));
+            connection.odd.reset();
+            pos = 1;
+        }
+        for (; pos + 1 < size; pos += 2)
+            check(connection, index++, static_cast<uint16_t>(static_cast<uint8_t>(data[pos]) | (static_cast<uint8_t>(data[pos + 1]) << 8)));
+        if (pos < size)
+            connection.odd = static_cast<uint8_t>(data[pos]);
+    }
+
+    void check(Connection& connection, uint64_t index, uint16_t sample)
+    {
+        if (!connection.key.has_value())
+            connection.key = sample;
+        if (sample != pattern(*connection.key, index))
+            ++connection.mismatches;
+    }
+
+    const Options& options_;
+    size_t period_bytes_;
+    microseconds period_;
+    boost::asio::io_context io_context_;
+    tcp::acceptor acceptor_;
+    std::vector<std::shared_ptr<Connection>> connections_;
+    Histogram jitter_;
+    nanoseconds cpu_time_{0};
+    std::thread thread_;
+};
+
+
+/// Sending side of a stream, does what the plugin's Prepare and Transfer do for every period
+class Driver
+{
+public:
+    Driver(const Options& options, uint16_t key, uint16_t port) : options_(options), key_(key)
+    {
+        stream_ = std::make_unique<SnapStream>(Uri("tcp://127.0.0.1:" + std::to_string(port)), options_.protocol);
+        auto channels = options_.format.channels();
+        mixer_.configure(SampleEncoding::s16le, ChannelMixer::defaultLayout(channels), SampleEncoding::s16le,
+                         ChannelMixer::defaultLayout(channels));
+        mixer_.setGain(options_.gain);
+        period_bytes_ = options_.period * options_.format.frameSize();
+        buffer_.resize(period_bytes_);
+        stream_->reserve(4, period_bytes_, false);
+    }
+
+    void start()
+    {
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    void join()
+    {
+        thread_.join();
+    }
+
+    uint16_t key() const
+    {
+        return key_;
+    }
+
+    uint64_t bytes() const
+    {
+        return bytes_;
+    }
+
+    const Stats& stats() const
+    {
+        return *stream_->stats();
+    }
+
+private:
+    void run()
+    {
+        stream_->start();
+        auto deadline = steady_clock::now() + 2s;
+        while (!stream_->stats()->connected && (steady_clock::now() < deadline))
+            std::this_thread::sleep_for(1ms);
+
+        auto channels = options_.format.channels();
+        std::vector<int16_t> period(options_.period * channels);
+        std::array<ChannelArea, 8> areas;
+        for (uint16_t c = 0; c < channels; ++c)
+            areas[c] = {period.data() + c, channels};
+
+        uint64_t index = 0;
+        auto end = steady_clock::now() + options_.duration;
+        auto next = steady_clock::now();
+        auto period_duration = duration<double>(static_cast<double>(options_.period) / options_.format.rate());
+        while (steady_clock::now() < end)
+        {
+            for (auto& sample : period)
+                sample = static_cast<int16_t>(pattern(key_, index++));
+
+            if (mixer_.isPassthrough())
+            {
+                stream_->write(period.data(), static_cast<uint32_t>(period_bytes_));
+            }
+            else
+            {
+                mixer_.mix(areas.data(), buffer_.data(), options_.period);
+                stream_->write(buffer_.data(), static_cast<uint32_t>(period_bytes_));
+            }
+            bytes_ += period_bytes_;
+
+            next += duration_cast<steady_clock::duration>(period_duration);
+            std::this_thread::sleep_until(next);
+        }
+        stream_->drain(2s);
+        stream_->stop();
+    }
+
+    const Options& options_;
+    uint16_t key_;
+    std::unique_ptr<SnapStream> stream_;
+    ChannelMixer mixer_;
+    size_t period_bytes_;
+    std::vector<uint8_t> buffer_;
+    uint64_t bytes_ = 0;
+    std::thread thread_;
+};
+
+
+nanoseconds processCpuTime()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+
+void usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  --streams <n>         number of streams (default 8)\n"
+              << "  --period <frames>     period size (default 1024)\n"
+              << "  --sampleformat <fmt>  rate:16:channels (default 48000:16:2)\n"
+              << "  --seconds <s>         duration (default 10)\n"
+              << "  --protocol <p>        raw or snapstream (default snapstream)\n"
+              << "  --gain <g>            mixer gain, != 1 disables the content check (default 1)\n";
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    AixLog::Log::init<AixLog::SinkCerr>(AixLog::Severity::warning);
+
+    Options options;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        if ((n + 1 == argc) || (arg == "--help"))
+        {
+            usage(argv[0]);
+            return (arg == "--help") ? 0 : 1;
+        }
+        std::string value = argv[++n];
+        if (arg == "--streams")
+            options.streams = std::stoul(value);
+        else if (arg == "--period")
+            options.period = std::stoul(value);
+        else if (arg == "--sampleformat")
+            options.format.setFormat(value);
+        else if (arg == "--seconds")
+            options.duration = seconds(std::stoul(value));
+        else if (arg == "--protocol")
+            options.protocol = (value == "raw") ? Protocol::raw : Protocol::snapstream;
+        else if (arg == "--gain")
+            options.gain = std::stof(value);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((options.format.bits() != 16) || (options.streams == 0) || (options.streams > 65535))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Sink sink(options);
+    std::vector<std::unique_ptr<Driver>> drivers;
+    for (size_t n = 0; n < options.streams; ++n)
+        drivers.push_back(std::make_unique<Driver>(options, static_cast<uint16_t>(n * 0x9E37 + 1), sink.port()));
+
+    auto cpu_start = processCpuTime();
+    auto start = steady_clock::now();
+    for (auto& driver : drivers)
+        driver->start();
+    for (auto& driver : drivers)
+        driver->join();
+    auto wall = duration<double>(steady_clock::now() - start);
+    std::this_thread::sleep_for(100ms);
+    sink.stop();
+    auto cpu = duration<double>(processCpuTime() - cpu_start - sink.cpuTime());
+
+    // Verify every stream, streams are identified by their content
+    bool ok = true;
+    std::map<uint16_t, const Connection*> connections;
+    uint64_t received_total = 0;
+    for (const auto& connection : sink.connections())
+    {
+        received_total += connection->bytes;
+        if (connection->key.has_value())
+            connections[*connection->key] = connection.get();
+    }
+    uint64_t sent_total = 0;
+    uint64_t wire_us = 0;
+    for (const auto& driver : drivers)
+    {
+        sent_total += driver->bytes();
+        wire_us = std::max(wire_us, driver->stats().wire_us.percentile(99.9));
+        if (options.gain != 1.f)
+            continue;
+        auto iter = connections.find(driver->key());
+        uint64_t received = (iter != connections.end()) ? iter->second->bytes : 0;
+        uint64_t mismatches = (iter != connections.end()) ? iter->second->mismatches : 0;
+        if ((received != driver->bytes()) || (mismatches != 0))
+        {
+            ok = false;
+            std::cout << "stream " << driver->key() << ": sent " << driver->bytes() << " bytes, received " << received
+                      << ", mismatched samples: " << mismatches << "\n";
+        }
+    }
+    if (sent_total != received_total)
+    {
+        ok = false;
+        std::cout << "sent " << sent_total << " bytes, received " << received_total << "\n";
+    }
+
+    auto cpu_per_stream = cpu.count() / wall.count() / static_cast<double>(options.streams);
+    std::cout << "streams: " << options.streams << ", sampleformat: " << options.format.toString()
+              << ", period: " << options.period << " frames, protocol: "
+              << (options.protocol == Protocol::raw ? "raw" : "snapstream") << ", duration: " << wall.count() << " s\n";
+    std::cout << "cpu per stream: " << 100. * cpu_per_stream << " % of a core (without the sink)\n";
+    std::cout << "max streams per core: " << static_cast<uint64_t>(1. / std::max(cpu_per_stream, 1e-9)) << "\n";
+    std::cout << "inter-arrival jitter us: " << sink.jitter().toString() << "\n";
+    std::cout << "worst p99.9 queue to wire us: " << wire_us << "\n";
+    std::cout << "verification: " << (ok ? "ok" : "FAILED") << (options.gain != 1.f ? " (total byte count only)" : "")
+              << "\n";
+    return ok ? 0 : 1;
+}
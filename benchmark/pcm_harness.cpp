@@ -0,0 +1,470 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/// Drives the callbacks of the PCM plugin directly, without alsa-lib's PCM layer
+///
+/// The ioplug functions of alsa-lib are replaced by fakes, so that opening the plugin yields its snd_pcm_ioplug_t.
+/// Randomized lifecycles call Prepare, Start, Transfer, Pause, Stop, Drain and Close, while a second thread calls
+/// Pointer and GetChmap like an application polling the device. Built with -fsanitize=address or -fsanitize=thread,
+/// it finds races and use-after-free in the callbacks and in SnapStream.
+
+// local headers
+#include "aixlog.hpp"
+#include "clock.hpp"
+#include "protocol.hpp"
+#include "sample_format.hpp"
+
+// 3rd party headers
+#include <alsa/asoundlib.h>
+#include <alsa/pcm_external.h>
+#include <alsa/pcm_ioplug.h>
+#include <boost/asio.hpp>
+
+// standard headers
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+using boost::asio::ip::tcp;
+
+
+/// Fakes of alsa-lib's ioplug functions, they take precedence over the ones in libasound
+extern "C"
+{
+    int snd_pcm_ioplug_create(snd_pcm_ioplug_t* io, const char* /*name*/, snd_pcm_stream_t stream, int /*mode*/)
+    {
+        io->stream = stream;
+        // The harness finds the plugin by the handle that the open function returns
+        io->pcm = reinterpret_cast<snd_pcm_t*>(io);
+        return 0;
+    }
+
+    int snd_pcm_ioplug_set_param_list(snd_pcm_ioplug_t* /*io*/, int /*type*/, unsigned int /*num_list*/,
+                                      const unsigned int* /*list*/)
+    {
+        return 0;
+    }
+
+    int snd_pcm_ioplug_set_param_minmax(snd_pcm_ioplug_t* /*io*/, int /*type*/, unsigned int /*min*/,
+                                        unsigned int /*max*/)
+    {
+        return 0;
+    }
+
+    SND_PCM_PLUGIN_DEFINE_FUNC(snapcast);
+}
+
+
+namespace
+{
+
+struct Options
+{
+    size_t iterations = 1000;
+    /// maximum number of transfers per lifecycle
+    size_t transfers = 16;
+    size_t period = 32;
+    SampleFormat format{"48000:16:2"};
+    /// format on the wire, the client's format is converted into it if set
+    SampleFormat wireformat;
+    Protocol protocol = Protocol::snapstream;
+    bool playback = true;
+    bool capture = true;
+    /// pool_grace of the plugin, reuses the connection across lifecycles
+    milliseconds pool_grace{0};
+    unsigned int seed = 1;
+    /// pace with a VirtualClock, i.e. without sleeping
+    bool simulated = false;
+    /// pacing option of the plugin
+    std::string pacing = "realtime";
+    /// simd option of the plugin
+    std::string simd = "auto";
+};
+
+
+/// Snapserver stand-in: discards what it receives and sends some audio to every connection, for capture
+class Server
+{
+public:
+    explicit Server(const Options& options) : acceptor_(io_context_, {boost::asio::ip::make_address("127.0.0.1"), 0})
+    {
+        // Half a second of audio, so that captures find data
+        const auto& format = options.wireformat.isInitialized() ? options.wireformat : options.format;
+        std::vector<char> audio(format.rate() / 50 * format.frameSize(), 0);
+        for (size_t n = 0; n < 25; ++n)
+        {
+            if (options.protocol == Protocol::snapstream)
+            {
+                msg::Header header{static_cast<uint16_t>(msg::Type::audio), 0, static_cast<uint32_t>(audio.size())};
+                auto* bytes = reinterpret_cast<const char*>(&header);
+                greeting_.insert(greeting_.end(), bytes, bytes + sizeof(header));
+            }
+            greeting_.insert(greeting_.end(), audio.begin(), audio.end());
+        }
+        accept();
+        thread_ = std::thread([this]() { io_context_.run(); });
+    }
+
+    ~Server()
+    {
+        io_context_.stop();
+        thread_.join();
+    }
+
+    uint16_t port() const
+    {
+        return acceptor_.local_endpoint().port();
+    }
+
+private:
+    struct Connection
+    {
+        explicit Connection(boost::asio::io_context& io_context) : socket(io_context)
+        {
+        }
+        tcp::socket socket;
+        std::array<char, 16 * 1024> buffer;
+    };
+
+    void accept()
+    {
+        auto connection = std::make_shared<Connection>(io_context_);
+        acceptor_.async_accept(connection->socket, [this, connection](const boost::system::error_code& ec)
+        {
+            if (ec)
+                return;
+            boost::asio::async_write(connection->socket, boost::asio::buffer(greeting_),
+                                     [](const boost::system::error_code&, size_t) {});
+            read(connection);
+            accept();
+        });
+    }
+
+    void read(std::shared_ptr<Connection> connection)
+    {
+        connection->socket.async_read_some(boost::asio::buffer(connection->buffer),
+                                           [this, connection](const boost::system::error_code& ec, size_t)
+        {
+            if (!ec)
+                read(connection);
+        });
+    }
+
+    boost::asio::io_context io_context_;
+    tcp::acceptor acceptor_;
+    std::vector<char> greeting_;
+    std::thread thread_;
+};
+
+
+/// Outcome of all lifecycles
+struct Counters
+{
+    std::atomic<uint64_t> callbacks{0};
+    /// frames that Transfer accepted or delivered
+    std::atomic<uint64_t> frames{0};
+    /// callbacks that returned an error that ALSA doesn't expect in this state
+    std::atomic<uint64_t> errors{0};
+    /// Pointer returned a position outside of the buffer
+    std::atomic<uint64_t> bad_pointers{0};
+};
+
+
+/// Configuration node with @p key and string @p value
+snd_config_t* makeString(const char* key, const std::string& value)
+{
+    snd_config_t* node = nullptr;
+    snd_config_imake_string(&node, key, value.c_str());
+    return node;
+}
+
+
+/// Configuration node with @p key and integer @p value
+snd_config_t* makeInteger(const char* key, long value)
+{
+    snd_config_t* node = nullptr;
+    snd_config_imake_integer(&node, key, value);
+    return node;
+}
+
+
+/// One open-to-close lifecycle of the plugin with random operations
+class Lifecycle
+{
+public:
+    Lifecycle(const Options& options, Counters& counters, uint16_t port, std::mt19937& random)
+        : options_(options), counters_(counters), port_(port), random_(random)
+    {
+    }
+
+    void run(snd_pcm_stream_t direction)
+    {
+        snd_config_t* conf = nullptr;
+        snd_config_make_compound(&conf, nullptr, 0);
+        snd_config_add(conf, makeString("uri", "tcp://127.0.0.1:" + std::to_string(port_)));
+        snd_config_add(conf, makeString("sampleformat", options_.format.toString()));
+        if (options_.wireformat.isInitialized())
+            snd_config_add(conf, makeString("wireformat", options_.wireformat.toString()));
+        snd_config_add(conf, makeString("protocol", options_.protocol == Protocol::raw ? "raw" : "snapstream"));
+        snd_config_add(conf, makeString("logfilter", "warning"));
+        snd_config_add(conf, makeInteger("drain_timeout", 100));
+        snd_config_add(conf, makeInteger("pool_grace", options_.pool_grace.count()));
+        snd_config_add(conf, makeString("pacing", options_.pacing));
+        snd_config_add(conf, makeString("simd", options_.simd));
+
+        snd_pcm_t* pcm = nullptr;
+        int err = SND_PCM_PLUGIN_ENTRY(snapcast)(&pcm, "harness", nullptr, conf, direction, 0);
+        snd_config_delete(conf);
+        if (err < 0)
+        {
+            std::cerr << "Failed to open the plugin: " << err << "\n";
+            ++counters_.errors;
+            return;
+        }
+
+        ext_ = reinterpret_cast<snd_pcm_ioplug_t*>(pcm);
+        configure(direction);
+        check(ext_->callback->prepare(ext_));
+
+        std::atomic<bool> polling{true};
+        std::thread poller([this, &polling]()
+        {
+            while (polling)
+            {
+                auto pointer = ext_->callback->pointer(ext_);
+                ++counters_.callbacks;
+                if ((pointer < 0) || (static_cast<snd_pcm_uframes_t>(pointer) >= ext_->buffer_size))
+                    ++counters_.bad_pointers;
+                free(ext_->callback->get_chmap(ext_));
+                std::this_thread::yield();
+            }
+        });
+
+        check(ext_->callback->start(ext_));
+        auto transfers = std::uniform_int_distribution<size_t>(0, options_.transfers)(random_);
+        for (size_t n = 0; n < transfers; ++n)
+        {
+            transfer();
+            switch (std::uniform_int_distribution<int>(0, 15)(random_))
+            {
+                case 0:
+                    // Seek: drop the queued audio and restart
+                    check(ext_->callback->stop(ext_));
+                    check(ext_->callback->prepare(ext_));
+                    check(ext_->callback->start(ext_));
+                    break;
+                case 1:
+                    check(ext_->callback->pause(ext_, 1));
+                    check(ext_->callback->pause(ext_, 0));
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (std::uniform_int_distribution<int>(0, 1)(random_) == 0)
+            check(ext_->callback->drain(ext_));
+        check(ext_->callback->stop(ext_));
+
+        polling = false;
+        poller.join();
+        check(ext_->callback->close(ext_));
+    }
+
+private:
+    /// Set the hw params that alsa-lib would negotiate
+    void configure(snd_pcm_stream_t direction)
+    {
+        ext_->rate = options_.format.rate();
+        ext_->format = SND_PCM_FORMAT_S16_LE;
+        ext_->period_size = options_.period;
+        ext_->buffer_size = 4 * options_.period;
+        if (direction == SND_PCM_STREAM_CAPTURE)
+        {
+            ext_->access = SND_PCM_ACCESS_RW_INTERLEAVED;
+            ext_->channels = options_.format.channels();
+            ext_->nonblock = 1;
+        }
+        else
+        {
+            // Interleaved or not, with any number of channels to be mixed
+            ext_->access = (std::uniform_int_distribution<int>(0, 1)(random_) == 0) ? SND_PCM_ACCESS_RW_INTERLEAVED
+                                                                                     : SND_PCM_ACCESS_RW_NONINTERLEAVED;
+            ext_->channels = std::uniform_int_distribution<unsigned int>(1, 8)(random_);
+            ext_->nonblock = 0;
+        }
+        samples_.assign(ext_->buffer_size * ext_->channels, 0);
+        for (size_t n = 0; n < samples_.size(); ++n)
+            samples_[n] = static_cast<int16_t>(n * 31);
+    }
+
+    /// Transfer a period from the buffer's current position
+    void transfer()
+    {
+        std::vector<snd_pcm_channel_area_t> areas(ext_->channels);
+        for (unsigned int c = 0; c < ext_->channels; ++c)
+        {
+            if (ext_->access == SND_PCM_ACCESS_RW_INTERLEAVED)
+                areas[c] = {samples_.data(), c * 16, ext_->channels * 16};
+            else
+                areas[c] = {samples_.data() + c * ext_->buffer_size, 0, 16};
+        }
+        auto offset = offset_ % ext_->buffer_size;
+        auto result = ext_->callback->transfer(ext_, areas.data(), offset, ext_->period_size);
+        ++counters_.callbacks;
+        // A non-blocking capture might find no data
+        if ((result == -EAGAIN) && (ext_->stream == SND_PCM_STREAM_CAPTURE))
+            return;
+        if (result < 0)
+        {
+            std::cerr << "Transfer failed: " << result << "\n";
+            ++counters_.errors;
+            return;
+        }
+        offset_ += static_cast<snd_pcm_uframes_t>(result);
+        counters_.frames += static_cast<uint64_t>(result);
+    }
+
+    void check(int result)
+    {
+        ++counters_.callbacks;
+        if (result < 0)
+        {
+            std::cerr << "Callback failed: " << result << "\n";
+            ++counters_.errors;
+        }
+    }
+
+    const Options& options_;
+    Counters& counters_;
+    uint16_t port_;
+    std::mt19937& random_;
+    snd_pcm_ioplug_t* ext_ = nullptr;
+    std::vector<int16_t> samples_;
+    snd_pcm_uframes_t offset_ = 0;
+};
+
+
+void usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "  --iterations <n>      number of lifecycles (default 1000)\n"
+              << "  --transfers <n>       maximum transfers per lifecycle (default 16)\n"
+              << "  --period <frames>     period size (default 32)\n"
+              << "  --sampleformat <fmt>  rate:16:channels (default 48000:16:2)\n"
+              << "  --wireformat <fmt>    rate:bits:channels on the wire (default sampleformat)\n"
+              << "  --protocol <p>        raw or snapstream (default snapstream)\n"
+              << "  --direction <d>       playback, capture or both (default both)\n"
+              << "  --pool_grace <ms>     reuse connections across lifecycles (default 0)\n"
+              << "  --seed <n>            seed of the random operations (default 1)\n"
+              << "  --simulated <0|1>     pace with a virtual clock instead of sleeping (default 0)\n"
+              << "  --pacing <p>          none, realtime or server (default realtime)\n"
+              << "  --simd <level>        auto, generic, avx2 or avx512 (default auto)\n";
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    // Until the plugin is opened, the log goes to stderr
+    AixLog::Log::init<AixLog::SinkCerr>(AixLog::Severity::warning);
+
+    Options options;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        if ((n + 1 == argc) || (arg == "--help"))
+        {
+            usage(argv[0]);
+            return (arg == "--help") ? 0 : 1;
+        }
+        std::string value = argv[++n];
+        if (arg == "--iterations")
+            options.iterations = std::stoul(value);
+        else if (arg == "--transfers")
+            options.transfers = std::stoul(value);
+        else if (arg == "--period")
+            options.period = std::stoul(value);
+        else if (arg == "--sampleformat")
+            options.format.setFormat(value);
+        else if (arg == "--wireformat")
+            options.wireformat.setFormat(value);
+        else if (arg == "--protocol")
+            options.protocol = (value == "raw") ? Protocol::raw : Protocol::snapstream;
+        else if (arg == "--direction")
+        {
+            options.playback = (value != "capture");
+            options.capture = (value != "playback");
+        }
+        else if (arg == "--pool_grace")
+            options.pool_grace = milliseconds(std::stoul(value));
+        else if (arg == "--seed")
+            options.seed = static_cast<unsigned int>(std::stoul(value));
+        else if (arg == "--simulated")
+            options.simulated = (value != "0");
+        else if (arg == "--pacing")
+            options.pacing = value;
+        else if (arg == "--simd")
+            options.simd = value;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((options.format.bits() != 16) || (options.period == 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (options.simulated)
+        Clock::set(std::make_shared<VirtualClock>());
+
+    Server server(options);
+    Counters counters;
+    std::mt19937 random(options.seed);
+    auto start = steady_clock::now();
+    for (size_t n = 0; n < options.iterations; ++n)
+    {
+        Lifecycle lifecycle(options, counters, server.port(), random);
+        bool capture = !options.playback || (options.capture && (n % 2 == 1));
+        lifecycle.run(capture ? SND_PCM_STREAM_CAPTURE : SND_PCM_STREAM_PLAYBACK);
+    }
+    auto wall = duration<double>(steady_clock::now() - start);
+
+    std::cout << "lifecycles: " << options.iterations << ", " << static_cast<double>(options.iterations) / wall.count()
+              << " per second\n"
+              << "callbacks: " << counters.callbacks << "\n"
+              << "audio: " << static_cast<double>(counters.frames) / options.format.rate() << " s\n"
+              << "failed callbacks: " << counters.errors << "\n"
+              << "pointers outside of the buffer: " << counters.bad_pointers << "\n";
+    return ((counters.errors == 0) && (counters.bad_pointers == 0)) ? 0 : 1;
+}
@@ -0,0 +1,607 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "channel_mixer.hpp"
+
+// standard headers
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+
+namespace
+{
+
+/// Number of frames that are mixed at once
+constexpr size_t kBlockFrames = 256;
+
+/// -3 dB
+constexpr float kMinus3dB = 0.70710678f;
+
+using Pos = ChannelPosition;
+
+/// Candidates to route a source channel into, if the destination layout doesn't contain the source position
+/// The first group of positions that is completely contained in the destination layout is used.
+struct Fallback
+{
+    std::vector<Pos> positions;
+    float gain;
+};
+
+std::vector<Fallback> fallbacks(Pos position)
+{
+    switch (position)
+    {
+        case Pos::mono:
+            return {{{Pos::fc}, 1.f}, {{Pos::fl, Pos::fr}, 1.f}};
+        case Pos::fl:
+        case Pos::flc:
+        case Pos::flw:
+        case Pos::flh:
+            return {{{Pos::fl}, 1.f}, {{Pos::mono}, 1.f}};
+        case Pos::fr:
+        case Pos::frc:
+        case Pos::frw:
+        case Pos::frh:
+            return {{{Pos::fr}, 1.f}, {{Pos::mono}, 1.f}};
+        case Pos::fc:
+        case Pos::fch:
+        case Pos::tc:
+            return {{{Pos::fc}, 1.f}, {{Pos::mono}, 1.f}, {{Pos::fl, Pos::fr}, kMinus3dB}};
+        case Pos::rl:
+        case Pos::rlc:
+            return {{{Pos::rl}, 1.f}, {{Pos::sl}, 1.f}, {{Pos::fl}, kMinus3dB}, {{Pos::mono}, kMinus3dB}};
+        case Pos::sl:
+            return {{{Pos::sl}, 1.f}, {{Pos::rl}, 1.f}, {{Pos::fl}, kMinus3dB}, {{Pos::mono}, kMinus3dB}};
+        case Pos::rr:
+        case Pos::rrc:
+            return {{{Pos::rr}, 1.f}, {{Pos::sr}, 1.f}, {{Pos::fr}, kMinus3dB}, {{Pos::mono}, kMinus3dB}};
+        case Pos::sr:
+            return {{{Pos::sr}, 1.f}, {{Pos::rr}, 1.f}, {{Pos::fr}, kMinus3dB}, {{Pos::mono}, kMinus3dB}};
+        case Pos::rc:
+            return {{{Pos::rl, Pos::rr}, kMinus3dB},
+                    {{Pos::sl, Pos::sr}, kMinus3dB},
+                    {{Pos::fl, Pos::fr}, 0.5f},
+                    {{Pos::mono}, kMinus3dB}};
+        default:
+            // LFE is dropped if there is no LFE channel on the wire, unknown positions anyway
+            return {};
+    }
+}
+
+
+/// @return @p sample in encoding E as integer, sign extended from its significant bits
+template <SampleEncoding E>
+SIMD_INLINE int32_t toInt(typename EncodingTraits<E>::type sample)
+{
+    if constexpr (E == SampleEncoding::s24_3le)
+        return static_cast<int32_t>((static_cast<uint32_t>(sample.bytes[0]) << 8) |
+                                    (static_cast<uint32_t>(sample.bytes[1]) << 16) |
+                                    (static_cast<uint32_t>(sample.bytes[2]) << 24)) >>
+               8;
+    else if constexpr (E == SampleEncoding::s24_4le)
+        return static_cast<int32_t>(static_cast<uint32_t>(sample) << 8) >> 8;
+    else
+        return sample;
+}
+
+/// @return @p value as sample in encoding E
+template <SampleEncoding E>
+SIMD_INLINE typename EncodingTraits<E>::type fromInt(int32_t value)
+{
+    if constexpr (E == SampleEncoding::s24_3le)
+    {
+        auto bits = static_cast<uint32_t>(value);
+        return {{static_cast<uint8_t>(bits), static_cast<uint8_t>(bits >> 8), static_cast<uint8_t>(bits >> 16)}};
+    }
+    else
+    {
+        return static_cast<typename EncodingTraits<E>::type>(value);
+    }
+}
+
+/// Convert @p frames samples of one channel with distance @p stride into normalized floats
+template <SampleEncoding E>
+SIMD_INLINE void toFloat(const typename EncodingTraits<E>::type* source, size_t stride, float* destination,
+                         size_t frames)
+{
+    if constexpr (EncodingTraits<E>::is_float)
+    {
+        for (size_t n = 0; n < frames; ++n)
+            destination[n] = source[n * stride];
+    }
+    else
+    {
+        constexpr float scale = 1.f / static_cast<float>(1u << (EncodingTraits<E>::bits - 1));
+        for (size_t n = 0; n < frames; ++n)
+            destination[n] = static_cast<float>(toInt<E>(source[n * stride])) * scale;
+    }
+}
+
+/// Generate @p frames samples of TPDF noise with an amplitude of +/-1 LSB, derived from @p seed
+/// Every sample is a hash of its index, so that the loop can be vectorized.
+SIMD_INLINE void tpdf(uint32_t seed, float* destination, size_t frames)
+{
+    for (size_t n = 0; n < frames; ++n)
+    {
+        uint32_t x = (seed + static_cast<uint32_t>(n)) * 0x9e3779b1u;
+        x ^= x >> 15;
+        x *= 0x85ebca77u;
+        x ^= x >> 13;
+        // sum of two independent uniform distributions => triangular distribution
+        destination[n] = static_cast<float>(static_cast<int32_t>((x & 0xffffu) + (x >> 16)) - 0xffff) / 65536.f;
+    }
+}
+
+/// Convert @p frames normalized floats into samples of one channel with distance @p stride
+/// @p noise is added as dither before quantization, if not null. With an @p error, the quantization error of the
+/// previous sample is subtracted from each sample (first order noise shaping), and the last error is stored in it.
+/// @p source is used as scratch buffer.
+template <SampleEncoding E>
+SIMD_INLINE void fromFloat(float* source, const float* noise, float* error,
+                           typename EncodingTraits<E>::type* destination, size_t stride, size_t frames)
+{
+    if constexpr (EncodingTraits<E>::is_float)
+    {
+        for (size_t n = 0; n < frames; ++n)
+            destination[n * stride] = source[n];
+        return;
+    }
+
+    constexpr int Bits = EncodingTraits<E>::bits;
+    constexpr float scale = static_cast<float>(1u << (Bits - 1));
+    // the largest float below 2^31 for 32 bit, since 2^31 - 1 is not representable
+    constexpr float max = (Bits == 32) ? 2147483520.f : scale - 1.f;
+    // scale, dither, clamp and round in place: these loops can be vectorized, the strided store below can't
+    if ((noise != nullptr) && (error != nullptr))
+    {
+        // The error of the unclamped value is fed back, so that it stays bounded while clipping
+        float previous = *error;
+        for (size_t n = 0; n < frames; ++n)
+        {
+            float wanted = source[n] * scale - previous;
+            float quantized = std::floor(wanted + noise[n] + 0.5f);
+            previous = quantized - wanted;
+            source[n] = quantized;
+        }
+        *error = previous;
+    }
+    else if (noise != nullptr)
+    {
+        for (size_t n = 0; n < frames; ++n)
+            source[n] = source[n] * scale + noise[n];
+    }
+    else
+    {
+        for (size_t n = 0; n < frames; ++n)
+            source[n] *= scale;
+    }
+    for (size_t n = 0; n < frames; ++n)
+    {
+        float sample = source[n];
+        sample = (sample < -scale) ? -scale : sample;
+        sample = (sample > max) ? max : sample;
+        source[n] = sample + std::copysign(0.5f, sample);
+    }
+    for (size_t n = 0; n < frames; ++n)
+        destination[n * stride] = fromInt<E>(static_cast<int32_t>(source[n]));
+}
+
+/// Unsigned types to move samples of @p Size bytes without interpreting them: one sample and two samples (a frame of
+/// a stereo pair, void if there is none)
+template <size_t Size>
+struct Words;
+
+template <>
+struct Words<1>
+{
+    using one = uint8_t;
+    using two = uint16_t;
+};
+
+template <>
+struct Words<2>
+{
+    using one = uint16_t;
+    using two = uint32_t;
+};
+
+template <>
+struct Words<3>
+{
+    using one = Packed24;
+    using two = void;
+};
+
+template <>
+struct Words<4>
+{
+    using one = uint32_t;
+    using two = uint64_t;
+};
+
+/// Interleave two planar channels by packing the samples of a frame into one word (little endian)
+template <typename T, typename Frame>
+SIMD_INLINE void interleave2(const T* left, const T* right, Frame* destination, size_t frames)
+{
+    static_assert(sizeof(Frame) == 2 * sizeof(T));
+    using U = std::make_unsigned_t<T>;
+    for (size_t n = 0; n < frames; ++n)
+        destination[n] = static_cast<Frame>(static_cast<U>(left[n])) |
+                         (static_cast<Frame>(static_cast<U>(right[n])) << (8 * sizeof(T)));
+}
+
+/// Interleave @p channels channels from @p source into @p destination
+template <typename T, typename Frame2>
+SIMD_INLINE void interleave(const ChannelArea* source, size_t channels, T* destination, size_t frames)
+{
+    const T* first = static_cast<const T*>(source[0].address);
+    if ((channels == 1) && (source[0].stride == 1))
+    {
+        std::copy_n(first, frames, destination);
+        return;
+    }
+
+    // already interleaved
+    bool interleaved = true;
+    for (size_t c = 0; c < channels; ++c)
+        interleaved &= (source[c].stride == channels) && (static_cast<const T*>(source[c].address) == first + c);
+    if (interleaved)
+    {
+        std::copy_n(first, frames * channels, destination);
+        return;
+    }
+
+    if constexpr (!std::is_void_v<Frame2>)
+    {
+        if ((channels == 2) && (source[0].stride == 1) && (source[1].stride == 1))
+        {
+            interleave2(first, static_cast<const T*>(source[1].address), reinterpret_cast<Frame2*>(destination),
+                        frames);
+            return;
+        }
+    }
+
+    for (size_t c = 0; c < channels; ++c)
+    {
+        const T* in = static_cast<const T*>(source[c].address);
+        size_t stride = source[c].stride;
+        for (size_t n = 0; n < frames; ++n)
+            destination[n * channels + c] = in[n * stride];
+    }
+}
+
+} // namespace
+
+
+ChannelLayout ChannelMixer::defaultLayout(uint16_t channels)
+{
+    switch (channels)
+    {
+        case 1:
+            return {Pos::mono};
+        case 2:
+            return {Pos::fl, Pos::fr};
+        case 3:
+            return {Pos::fl, Pos::fr, Pos::lfe};
+        case 4:
+            return {Pos::fl, Pos::fr, Pos::rl, Pos::rr};
+        case 5:
+            return {Pos::fl, Pos::fr, Pos::rl, Pos::rr, Pos::fc};
+        case 6:
+            return {Pos::fl, Pos::fr, Pos::rl, Pos::rr, Pos::fc, Pos::lfe};
+        case 7:
+            return {Pos::fl, Pos::fr, Pos::rl, Pos::rr, Pos::fc, Pos::lfe, Pos::rc};
+        case 8:
+            return {Pos::fl, Pos::fr, Pos::rl, Pos::rr, Pos::fc, Pos::lfe, Pos::sl, Pos::sr};
+        default:
+            return ChannelLayout(channels, Pos::unknown);
+    }
+}
+
+
+void ChannelMixer::configure(SampleEncoding source_encoding, const ChannelLayout& source,
+                             SampleEncoding destination_encoding, const ChannelLayout& destination,
+                             const TransferTable& ttable)
+{
+    for (auto encoding : {source_encoding, destination_encoding})
+    {
+        if (static_cast<size_t>(encoding) >= kSampleEncodings)
+            throw std::invalid_argument("unsupported encoding: " + std::to_string(static_cast<int>(encoding)));
+    }
+
+    source_encoding_ = source_encoding;
+    encoding_ = destination_encoding;
+    in_channels_ = source.size();
+    out_channels_ = destination.size();
+    base_.assign(in_channels_ * out_channels_, 0.f);
+    identity_ = ttable.empty() && (source == destination);
+
+    auto gain = [this](size_t out, size_t in) -> float& { return base_[out * in_channels_ + in]; };
+
+    if (!ttable.empty())
+    {
+        for (const auto& [channels, value] : ttable)
+        {
+            if ((channels.first < in_channels_) && (channels.second < out_channels_))
+                gain(channels.second, channels.first) = value;
+        }
+    }
+    else if (identity_)
+    {
+        // Mono and unknown positions have no fallback into themselves
+        for (size_t c = 0; c < in_channels_; ++c)
+            gain(c, c) = 1.f;
+    }
+    else
+    {
+        auto indexOf = [&destination](Pos position) -> std::optional<size_t>
+        {
+            auto iter = std::find(destination.begin(), destination.end(), position);
+            if (iter == destination.end())
+                return std::nullopt;
+            return std::distance(destination.begin(), iter);
+        };
+
+        for (size_t in = 0; in < in_channels_; ++in)
+        {
+            for (const auto& fallback : fallbacks(source[in]))
+            {
+                bool contained = std::all_of(fallback.positions.begin(), fallback.positions.end(),
+                                             [&](Pos position) { return indexOf(position).has_value(); });
+                if (!contained)
+                    continue;
+                for (auto position : fallback.positions)
+                    gain(*indexOf(position), in) += fallback.gain;
+                break;
+            }
+        }
+
+        // Normalize the downmix, so that a full scale signal on all source channels cannot clip
+        for (size_t out = 0; out < out_channels_; ++out)
+        {
+            float sum = 0;
+            for (size_t in = 0; in < in_channels_; ++in)
+                sum += gain(out, in);
+            if (sum > 1.f)
+            {
+                for (size_t in = 0; in < in_channels_; ++in)
+                    gain(out, in) /= sum;
+            }
+        }
+    }
+
+    planes_.resize(in_channels_ * kBlockFrames);
+    accumulator_.resize(kBlockFrames);
+    noise_.resize(kBlockFrames);
+    error_.assign(out_channels_, 0.f);
+    setGain(gain_);
+}
+
+
+void ChannelMixer::setGain(float gain)
+{
+    gain_ = gain;
+    passthrough_ = identity_ && (gain_ == 1.f) && (source_encoding_ == encoding_);
+    matrix_ = base_;
+    for (auto& value : matrix_)
+        value *= gain_;
+
+    // Samples are only requantized if an output channel is not just a copy of an input channel, or has less bits
+    bool narrower =
+        (source_encoding_ == SampleEncoding::f32le) || (sampleBits(encoding_) < sampleBits(source_encoding_));
+    requantize_ = (encoding_ != SampleEncoding::f32le) && narrower;
+    for (size_t out = 0; out < out_channels_; ++out)
+    {
+        size_t sources = 0;
+        for (size_t in = 0; in < in_channels_; ++in)
+        {
+            float value = matrix_[out * in_channels_ + in];
+            sources += (value != 0.f) ? 1 : 0;
+            requantize_ |= (value != 0.f) && (value != 1.f);
+        }
+        requantize_ |= (sources > 1);
+    }
+    selectKernel();
+}
+
+
+void ChannelMixer::setDither(bool enabled)
+{
+    dither_ = enabled;
+}
+
+
+void ChannelMixer::setNoiseShaping(bool enabled)
+{
+    noise_shaping_ = enabled;
+}
+
+
+std::string ChannelMixer::toString() const
+{
+    if (passthrough_)
+        return "passthrough";
+    std::stringstream ss;
+    for (size_t out = 0; out < out_channels_; ++out)
+    {
+        ss << (out == 0 ? "" : " | ");
+        for (size_t in = 0; in < in_channels_; ++in)
+            ss << (in == 0 ? "" : " ") << matrix_[out * in_channels_ + in];
+    }
+    return ss.str();
+}
+
+
+template <SampleEncoding E>
+SIMD_INLINE void ChannelMixer::copyFrames(const ChannelArea* source, void* destination, size_t frames)
+{
+    using W = Words<sizeof(typename EncodingTraits<E>::type)>;
+    interleave<typename W::one, typename W::two>(source, in_channels_, static_cast<typename W::one*>(destination),
+                                                 frames);
+}
+
+
+template <SampleEncoding In, SampleEncoding Out>
+SIMD_INLINE void ChannelMixer::mixFrames(const ChannelArea* source, void* destination, size_t frames)
+{
+    using InType = typename EncodingTraits<In>::type;
+    using OutType = typename EncodingTraits<Out>::type;
+    for (size_t offset = 0; offset < frames; offset += kBlockFrames)
+    {
+        size_t count = std::min(kBlockFrames, frames - offset);
+        OutType* out = static_cast<OutType*>(destination) + offset * out_channels_;
+
+        for (size_t c = 0; c < in_channels_; ++c)
+        {
+            const InType* in = static_cast<const InType*>(source[c].address) + offset * source[c].stride;
+            toFloat<In>(in, source[c].stride, planes_.data() + c * kBlockFrames, count);
+        }
+
+        for (size_t o = 0; o < out_channels_; ++o)
+        {
+            float* acc = accumulator_.data();
+            std::fill_n(acc, count, 0.f);
+            for (size_t c = 0; c < in_channels_; ++c)
+            {
+                float gain = matrix_[o * in_channels_ + c];
+                if (gain == 0.f)
+                    continue;
+                const float* plane = planes_.data() + c * kBlockFrames;
+                for (size_t n = 0; n < count; ++n)
+                    acc[n] += gain * plane[n];
+            }
+
+            // Requantization to 16 bits or less is audible without dither
+            const float* noise = nullptr;
+            float* error = nullptr;
+            if constexpr (!EncodingTraits<Out>::is_float && (EncodingTraits<Out>::bits <= 16))
+            {
+                if (dither_ && requantize_)
+                {
+                    tpdf(dither_seed_, noise_.data(), count);
+                    dither_seed_ += static_cast<uint32_t>(count);
+                    noise = noise_.data();
+                    if (noise_shaping_)
+                        error = &error_[o];
+                }
+            }
+            fromFloat<Out>(acc, noise, error, out + o, out_channels_, count);
+        }
+    }
+}
+
+
+template <SampleEncoding E>
+void ChannelMixer::copy(const ChannelArea* source, void* destination, size_t frames)
+{
+    copyFrames<E>(source, destination, frames);
+}
+
+
+template <SampleEncoding E>
+SIMD_TARGET_AVX2 void ChannelMixer::copyAvx2(const ChannelArea* source, void* destination, size_t frames)
+{
+    copyFrames<E>(source, destination, frames);
+}
+
+
+template <SampleEncoding E>
+SIMD_TARGET_AVX512 void ChannelMixer::copyAvx512(const ChannelArea* source, void* destination, size_t frames)
+{
+    copyFrames<E>(source, destination, frames);
+}
+
+
+template <SampleEncoding In, SampleEncoding Out>
+void ChannelMixer::mix(const ChannelArea* source, void* destination, size_t frames)
+{
+    mixFrames<In, Out>(source, destination, frames);
+}
+
+
+template <SampleEncoding In, SampleEncoding Out>
+SIMD_TARGET_AVX2 void ChannelMixer::mixAvx2(const ChannelArea* source, void* destination, size_t frames)
+{
+    mixFrames<In, Out>(source, destination, frames);
+}
+
+
+template <SampleEncoding In, SampleEncoding Out>
+SIMD_TARGET_AVX512 void ChannelMixer::mixAvx512(const ChannelArea* source, void* destination, size_t frames)
+{
+    mixFrames<In, Out>(source, destination, frames);
+}
+
+
+template <SimdLevel L, size_t... Encodings>
+constexpr std::array<ChannelMixer::Kernel, sizeof...(Encodings)>
+ChannelMixer::copyKernels(std::index_sequence<Encodings...>)
+{
+    // Without runtime dispatch, the other levels would only duplicate the generic kernels
+    if constexpr (kSimdDispatch && (L == SimdLevel::avx512))
+        return {&ChannelMixer::copyAvx512<static_cast<SampleEncoding>(Encodings)>...};
+    else if constexpr (kSimdDispatch && (L == SimdLevel::avx2))
+        return {&ChannelMixer::copyAvx2<static_cast<SampleEncoding>(Encodings)>...};
+    else
+        return {&ChannelMixer::copy<static_cast<SampleEncoding>(Encodings)>...};
+}
+
+
+template <SimdLevel L, size_t... Pairs>
+constexpr std::array<ChannelMixer::Kernel, sizeof...(Pairs)> ChannelMixer::mixKernels(std::index_sequence<Pairs...>)
+{
+    if constexpr (kSimdDispatch && (L == SimdLevel::avx512))
+        return {&ChannelMixer::mixAvx512<static_cast<SampleEncoding>(Pairs / kSampleEncodings),
+                                         static_cast<SampleEncoding>(Pairs % kSampleEncodings)>...};
+    else if constexpr (kSimdDispatch && (L == SimdLevel::avx2))
+        return {&ChannelMixer::mixAvx2<static_cast<SampleEncoding>(Pairs / kSampleEncodings),
+                                       static_cast<SampleEncoding>(Pairs % kSampleEncodings)>...};
+    else
+        return {&ChannelMixer::mix<static_cast<SampleEncoding>(Pairs / kSampleEncodings),
+                                   static_cast<SampleEncoding>(Pairs % kSampleEncodings)>...};
+}
+
+
+void ChannelMixer::selectKernel()
+{
+    using Encodings = std::make_index_sequence<kSampleEncodings>;
+    using Pairs = std::make_index_sequence<kSampleEncodings * kSampleEncodings>;
+    static constexpr std::array<std::array<Kernel, kSampleEncodings>, kSimdLevels> copy_kernels{
+        copyKernels<SimdLevel::generic>(Encodings()), copyKernels<SimdLevel::avx2>(Encodings()),
+        copyKernels<SimdLevel::avx512>(Encodings())};
+    static constexpr std::array<std::array<Kernel, kSampleEncodings * kSampleEncodings>, kSimdLevels> mix_kernels{
+        mixKernels<SimdLevel::generic>(Pairs()), mixKernels<SimdLevel::avx2>(Pairs()),
+        mixKernels<SimdLevel::avx512>(Pairs())};
+
+    auto level = static_cast<size_t>(simd::active());
+    auto in = static_cast<size_t>(source_encoding_);
+    auto out = static_cast<size_t>(encoding_);
+    kernel_ = passthrough_ ? copy_kernels[level][out] : mix_kernels[level][in * kSampleEncodings + out];
+}
+
+
+void ChannelMixer::mix(const ChannelArea* source, void* destination, size_t frames)
+{
+    (this->*kernel_)(source, destination, frames);
+}
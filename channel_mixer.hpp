@@ -0,0 +1,186 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// local headers
+#include "sample_format.hpp"
+#include "simd.hpp"
+
+// standard headers
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/// Position of a channel within a frame, the values match ALSA's snd_pcm_chmap_position
+enum class ChannelPosition : uint8_t
+{
+    unknown = 0,
+    na,
+    mono,
+    fl,
+    fr,
+    rl,
+    rr,
+    fc,
+    lfe,
+    sl,
+    sr,
+    rc,
+    flc,
+    frc,
+    rlc,
+    rrc,
+    flw,
+    frw,
+    flh,
+    fch,
+    frh,
+    tc
+};
+
+/// Channel positions of all channels in a frame
+using ChannelLayout = std::vector<ChannelPosition>;
+
+/// Transfer table entries as used by the ALSA route plugin: (source channel, destination channel) => gain
+using TransferTable = std::map<std::pair<uint16_t, uint16_t>, float>;
+
+
+/// Location of one channel's samples
+struct ChannelArea
+{
+    /// address of the first sample
+    const void* address;
+    /// distance between two consecutive samples, in samples
+    size_t stride;
+};
+
+
+/// Mixes audio with an arbitrary channel layout into the interleaved channel layout sent over the wire
+/// The mixing is done in blocks on deinterleaved float samples, so that the inner loops can be vectorized. The sample
+/// encoding is converted on the way, e.g. from the client's float to 16 bits on the wire. The kernels are instantiated
+/// for every pair of encodings and SimdLevel, and selected for simd::active() when configuring, so that mixing doesn't
+/// branch on the encodings or the CPU. All levels produce bit identical output.
+/// A gain is folded into the mixing matrix, so that volume changes don't cost an extra pass over the audio.
+class ChannelMixer
+{
+public:
+    /// Prepare mixing of @p source layout in @p source_encoding into @p destination layout in @p destination_encoding
+    /// The mixing matrix is derived from the channel positions, unless a @p ttable is given
+    void configure(SampleEncoding source_encoding, const ChannelLayout& source, SampleEncoding destination_encoding,
+                   const ChannelLayout& destination, const TransferTable& ttable = {});
+
+    /// Set the linear @p gain that is applied while mixing, 1 by default
+    void setGain(float gain);
+
+    /// @return the linear gain that is applied while mixing
+    float gain() const
+    {
+        return gain_;
+    }
+
+    /// Enable or disable TPDF dither when requantizing to 16 bits or less, enabled by default
+    void setDither(bool enabled);
+
+    /// Enable or disable first order noise shaping of the dither, which moves the noise towards high frequencies
+    /// Disabled by default, the error feedback is a serial dependency that can't be vectorized.
+    void setNoiseShaping(bool enabled);
+
+    /// @return true if the layouts and encodings are identical and the gain is 1, i.e. the audio only needs to be
+    /// interleaved
+    bool isPassthrough() const
+    {
+        return passthrough_;
+    }
+
+    /// Mix @p frames frames from the interleaved or planar channels in @p source into @p destination
+    /// Must not be called before configure()
+    void mix(const ChannelArea* source, void* destination, size_t frames);
+
+    /// @return mixing matrix as string, for logging purposes
+    std::string toString() const;
+
+    /// @return the default ALSA channel layout for @p channels
+    static ChannelLayout defaultLayout(uint16_t channels);
+
+private:
+    using Kernel = void (ChannelMixer::*)(const ChannelArea* source, void* destination, size_t frames);
+
+    /// Interleave @p frames frames of @p source samples in encoding E into @p destination
+    template <SampleEncoding E>
+    SIMD_INLINE void copyFrames(const ChannelArea* source, void* destination, size_t frames);
+    /// Mix @p frames frames of @p source samples in encoding In into @p destination samples in encoding Out
+    template <SampleEncoding In, SampleEncoding Out>
+    SIMD_INLINE void mixFrames(const ChannelArea* source, void* destination, size_t frames);
+
+    /// copyFrames() and mixFrames(), compiled for each SimdLevel
+    template <SampleEncoding E>
+    void copy(const ChannelArea* source, void* destination, size_t frames);
+    template <SampleEncoding E>
+    SIMD_TARGET_AVX2 void copyAvx2(const ChannelArea* source, void* destination, size_t frames);
+    template <SampleEncoding E>
+    SIMD_TARGET_AVX512 void copyAvx512(const ChannelArea* source, void* destination, size_t frames);
+    template <SampleEncoding In, SampleEncoding Out>
+    void mix(const ChannelArea* source, void* destination, size_t frames);
+    template <SampleEncoding In, SampleEncoding Out>
+    SIMD_TARGET_AVX2 void mixAvx2(const ChannelArea* source, void* destination, size_t frames);
+    template <SampleEncoding In, SampleEncoding Out>
+    SIMD_TARGET_AVX512 void mixAvx512(const ChannelArea* source, void* destination, size_t frames);
+
+    /// @return the copy kernel of level L for each encoding
+    template <SimdLevel L, size_t... Encodings>
+    static constexpr std::array<Kernel, sizeof...(Encodings)> copyKernels(std::index_sequence<Encodings...>);
+    /// @return the mix kernel of level L for each pair of encodings, indexed by source * kSampleEncodings + destination
+    template <SimdLevel L, size_t... Pairs>
+    static constexpr std::array<Kernel, sizeof...(Pairs)> mixKernels(std::index_sequence<Pairs...>);
+    /// Select kernel_ for the encodings and simd::active(), passthrough_ must be up to date
+    void selectKernel();
+
+    SampleEncoding source_encoding_ = SampleEncoding::s16le;
+    SampleEncoding encoding_ = SampleEncoding::s16le;
+    /// the kernel that mix() runs, selected by configure()
+    Kernel kernel_ = nullptr;
+    size_t in_channels_ = 0;
+    size_t out_channels_ = 0;
+    /// source and destination layouts are identical
+    bool identity_ = true;
+    bool passthrough_ = true;
+    float gain_ = 1.f;
+    bool dither_ = true;
+    bool noise_shaping_ = false;
+    /// the mixing matrix changes sample values, i.e. dither is needed
+    bool requantize_ = false;
+    uint32_t dither_seed_ = 0;
+    /// row major out_channels_ x in_channels_ gains, as configured
+    std::vector<float> base_;
+    /// base_ with the gain applied
+    std::vector<float> matrix_;
+    /// deinterleaved input block, one plane per input channel
+    std::vector<float> planes_;
+    /// output block of a single output channel
+    std::vector<float> accumulator_;
+    /// dither noise for one block
+    std::vector<float> noise_;
+    /// quantization error of the last sample of each output channel, for noise shaping
+    std::vector<float> error_;
+};
@@ -0,0 +1,103 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "clock.hpp"
+
+// standard headers
+#include <thread>
+
+
+namespace
+{
+/// keeps the clock that was set alive
+std::shared_ptr<Clock> custom_clock;
+/// the process wide clock, read on every call of Clock::instance()
+std::atomic<Clock*> current_clock{nullptr};
+} // namespace
+
+
+Clock& Clock::instance()
+{
+    static SteadyClock steady;
+    Clock* clock = current_clock.load(std::memory_order_acquire);
+    return (clock != nullptr) ? *clock : steady;
+}
+
+
+void Clock::set(std::shared_ptr<Clock> clock)
+{
+    current_clock.store(clock.get(), std::memory_order_release);
+    custom_clock = std::move(clock);
+}
+
+
+Clock::time_point SteadyClock::now() const
+{
+    return std::chrono::steady_clock::now();
+}
+
+
+void SteadyClock::sleepUntil(time_point deadline)
+{
+    std::this_thread::sleep_until(deadline);
+}
+
+
+VirtualClock::VirtualClock(bool auto_advance, time_point start)
+    : auto_advance_(auto_advance), now_(start.time_since_epoch().count())
+{
+}
+
+
+Clock::time_point VirtualClock::now() const
+{
+    return time_point(duration(now_.load(std::memory_order_acquire)));
+}
+
+
+void VirtualClock::sleepUntil(time_point deadline)
+{
+    if (auto_advance_)
+    {
+        advanceTo(deadline);
+        return;
+    }
+
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [this, deadline]() { return now() >= deadline; });
+}
+
+
+void VirtualClock::advance(duration duration)
+{
+    advanceTo(now() + duration);
+}
+
+
+void VirtualClock::advanceTo(time_point time)
+{
+    {
+        // Sleepers check the time under the lock, so that they don't miss the notification
+        std::scoped_lock lock(mutex_);
+        auto count = now_.load(std::memory_order_relaxed);
+        if (time.time_since_epoch().count() > count)
+            now_.store(time.time_since_epoch().count(), std::memory_order_release);
+    }
+    cv_.notify_all();
+}
@@ -0,0 +1,141 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// 3rd party headers
+#include <boost/asio/basic_waitable_timer.hpp>
+
+// standard headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+
+/// Time source of the pacing, the timestamps and the timers of the streams
+///
+/// The process wide instance is the steady clock. Tests replace it with a VirtualClock, so that hours of playback or
+/// a series of reconnects with their timeouts run in seconds and don't depend on the scheduler.
+class Clock
+{
+public:
+    using duration = std::chrono::steady_clock::duration;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    virtual ~Clock() = default;
+
+    /// @return the current time
+    virtual time_point now() const = 0;
+    /// Block the calling thread until @p deadline
+    virtual void sleepUntil(time_point deadline) = 0;
+    /// @return true if the time doesn't pass by itself, i.e. timers have to poll it
+    virtual bool isVirtual() const
+    {
+        return false;
+    }
+
+    /// @return the process wide clock
+    static Clock& instance();
+    /// Replace the process wide clock, nullptr restores the steady clock
+    /// Must be called while no stream is running, e.g. before opening the first device.
+    static void set(std::shared_ptr<Clock> clock);
+};
+
+
+/// std::chrono::steady_clock
+class SteadyClock : public Clock
+{
+public:
+    time_point now() const override;
+    void sleepUntil(time_point deadline) override;
+};
+
+
+/// Simulated time that only passes when it is advanced
+///
+/// With auto advance, sleeping advances the time to the deadline and returns immediately, i.e. the pacing runs as
+/// fast as the CPU allows. Otherwise sleepers block until advance() reaches their deadline.
+class VirtualClock : public Clock
+{
+public:
+    /// c'tor
+    /// @param auto_advance sleeping advances the time
+    /// @param start the initial time, not 0 which is used as "unset" time point
+    explicit VirtualClock(bool auto_advance = true, time_point start = time_point(std::chrono::hours(1)));
+
+    time_point now() const override;
+    void sleepUntil(time_point deadline) override;
+    bool isVirtual() const override
+    {
+        return true;
+    }
+
+    /// Advance the time by @p duration and wake up the sleepers whose deadline has been reached
+    void advance(duration duration);
+
+private:
+    /// Advance the time to @p time, if it is later than now
+    void advanceTo(time_point time);
+
+    bool auto_advance_;
+    std::atomic<duration::rep> now_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+
+/// Adapts the process wide Clock to asio's timers
+struct TimerClock
+{
+    using duration = Clock::duration;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = Clock::time_point;
+    static constexpr bool is_steady = true;
+
+    static time_point now()
+    {
+        return Clock::instance().now();
+    }
+};
+
+
+/// Lets the io_context poll a virtual clock, whose time doesn't pass while the reactor waits in the kernel
+struct TimerWaitTraits
+{
+    /// Maximum time that the reactor waits in the kernel with a virtual clock
+    static constexpr auto kPollInterval = std::chrono::milliseconds(1);
+
+    static TimerClock::duration to_wait_duration(const TimerClock::duration& duration)
+    {
+        if (Clock::instance().isVirtual() && (duration > kPollInterval))
+            return kPollInterval;
+        return duration;
+    }
+
+    static TimerClock::duration to_wait_duration(const TimerClock::time_point& time)
+    {
+        return to_wait_duration(time - TimerClock::now());
+    }
+};
+
+
+/// Timer that expires according to the process wide Clock
+using Timer = boost::asio::basic_waitable_timer<TimerClock, TimerWaitTraits>;
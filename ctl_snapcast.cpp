@@ -0,0 +1,314 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+
+// local headers
+#include "aixlog.hpp"
+#include "uri.hpp"
+#include "volume.hpp"
+
+// 3rd party headers
+#include <alsa/asoundlib.h>
+#include <alsa/conf.h>
+#include <alsa/control_external.h>
+
+// standard headers
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+static constexpr auto LOG_TAG = "SnapcastCTL";
+
+
+/// An ALSA CTL plugin exposing the volume of the Snapcast PCM device with the same uri
+/// The volume is shared through Volume::get() and thus only within one process: the control changes the volume of
+/// the PCM devices opened by the same application, not of other processes playing to the same uri.
+class SnapcastCtl
+{
+private:
+    enum Key : snd_ctl_ext_key_t
+    {
+        kVolume = 0,
+        kSwitch = 1,
+        kCount = 2
+    };
+
+    static constexpr std::array<const char*, kCount> kNames{"Master Playback Volume", "Master Playback Switch"};
+
+    /// shared with the PCM instances of the device
+    std::shared_ptr<Volume> volume;
+    /// signaled by volume on changes, polled by ALSA
+    int event_fd{-1};
+    /// last values reported with ReadEvent
+    uint16_t reported_percent{0};
+    bool reported_muted{false};
+
+    static SnapcastCtl* Self(snd_ctl_ext_t* ext)
+    {
+        return static_cast<SnapcastCtl*>(ext->private_data);
+    }
+
+    static void Close(snd_ctl_ext_t* ext)
+    {
+        LOG(INFO, LOG_TAG) << "Close\n";
+        auto* self = Self(ext);
+        // ext is a member of self
+        ext->private_data = nullptr;
+        delete self;
+    }
+
+    static int ElemCount(snd_ctl_ext_t* /*ext*/)
+    {
+        return kCount;
+    }
+
+    static int ElemList(snd_ctl_ext_t* /*ext*/, unsigned int offset, snd_ctl_elem_id_t* id)
+    {
+        if (offset >= kCount)
+            return -EINVAL;
+        snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+        snd_ctl_elem_id_set_name(id, kNames[offset]);
+        return 0;
+    }
+
+    static snd_ctl_ext_key_t FindElem(snd_ctl_ext_t* /*ext*/, const snd_ctl_elem_id_t* id)
+    {
+        const char* name = snd_ctl_elem_id_get_name(id);
+        for (snd_ctl_ext_key_t key = 0; key < kCount; ++key)
+        {
+            if (strcmp(name, kNames[key]) == 0)
+                return key;
+        }
+        return SND_CTL_EXT_KEY_NOT_FOUND;
+    }
+
+    static int GetAttribute(snd_ctl_ext_t* /*ext*/, snd_ctl_ext_key_t key, int* type, unsigned int* acc,
+                            unsigned int* count)
+    {
+        if (key >= kCount)
+            return -EINVAL;
+        *type = (key == kVolume) ? SND_CTL_ELEM_TYPE_INTEGER : SND_CTL_ELEM_TYPE_BOOLEAN;
+        *acc = SND_CTL_EXT_ACCESS_READWRITE;
+        *count = 1;
+        return 0;
+    }
+
+    static int GetIntegerInfo(snd_ctl_ext_t* /*ext*/, snd_ctl_ext_key_t key, long* imin, long* imax, long* istep)
+    {
+        if (key != kVolume)
+            return -EINVAL;
+        *imin = 0;
+        *imax = 100;
+        *istep = 1;
+        return 0;
+    }
+
+    static int ReadInteger(snd_ctl_ext_t* ext, snd_ctl_ext_key_t key, long* value)
+    {
+        auto* self{Self(ext)};
+        if (key == kVolume)
+            *value = self->volume->percent();
+        else if (key == kSwitch)
+            *value = self->volume->muted() ? 0 : 1;
+        else
+            return -EINVAL;
+        return 0;
+    }
+
+    static int WriteInteger(snd_ctl_ext_t* ext, snd_ctl_ext_key_t key, long* value)
+    {
+        auto* self{Self(ext)};
+        LOG(DEBUG, LOG_TAG) << "WriteInteger, key: " << key << ", value: " << *value << "\n";
+        if (key == kVolume)
+        {
+            if ((*value < 0) || (*value > 100))
+                return -EINVAL;
+            if (self->volume->percent() == *value)
+                return 0;
+            self->volume->setPercent(static_cast<uint16_t>(*value));
+        }
+        else if (key == kSwitch)
+        {
+            bool muted = (*value == 0);
+            if (self->volume->muted() == muted)
+                return 0;
+            self->volume->setMuted(muted);
+        }
+        else
+        {
+            return -EINVAL;
+        }
+        // the value has changed
+        return 1;
+    }
+
+    static void SubscribeEvents(snd_ctl_ext_t* ext, int subscribe)
+    {
+        auto* self{Self(ext)};
+        ext->subscribed = subscribe;
+        self->reported_percent = self->volume->percent();
+        self->reported_muted = self->volume->muted();
+    }
+
+    static int ReadEvent(snd_ctl_ext_t* ext, snd_ctl_elem_id_t* id, unsigned int* event_mask)
+    {
+        auto* self{Self(ext)};
+        uint64_t count;
+        while (read(self->event_fd, &count, sizeof(count)) == sizeof(count))
+        {
+        }
+
+        if (!ext->subscribed)
+            return -EAGAIN;
+
+        // Report one changed element per call, ALSA reads events until -EAGAIN
+        Key key;
+        if (self->reported_percent != self->volume->percent())
+        {
+            self->reported_percent = self->volume->percent();
+            key = kVolume;
+        }
+        else if (self->reported_muted != self->volume->muted())
+        {
+            self->reported_muted = self->volume->muted();
+            key = kSwitch;
+        }
+        else
+        {
+            return -EAGAIN;
+        }
+
+        snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+        snd_ctl_elem_id_set_name(id, kNames[key]);
+        *event_mask = SND_CTL_EVENT_MASK_VALUE;
+        return 1;
+    }
+
+    constexpr static snd_ctl_ext_callback_t Callbacks{
+        .close = &Close,
+        .elem_count = &ElemCount,
+        .elem_list = &ElemList,
+        .find_elem = &FindElem,
+        .get_attribute = &GetAttribute,
+        .get_integer_info = &GetIntegerInfo,
+        .read_integer = &ReadInteger,
+        .write_integer = &WriteInteger,
+        .subscribe_events = &SubscribeEvents,
+        .read_event = &ReadEvent,
+    };
+
+public:
+    snd_ctl_ext_t ext{
+        .version = SND_CTL_EXT_VERSION,
+        .card_idx = 0,
+        .id = "Snapcast",
+        .driver = "Snapcast",
+        .name = "Snapcast",
+        .longname = "ALSA <-> Snapcast CTL Plugin",
+        .mixername = "Snapcast",
+        .poll_fd = -1,
+        .callback = &Callbacks,
+        .private_data = this,
+    };
+
+    SnapcastCtl()
+    {
+        LOG(INFO, LOG_TAG) << "Create SnapcastCtl\n";
+    }
+
+    int Initialize(const char* name, int mode, const Uri& uri)
+    {
+        LOG(INFO, LOG_TAG) << "Initialize name: " << name << ", mode: " << mode << ", uri: " << uri.toString() << "\n";
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd < 0)
+            return -errno;
+
+        volume = Volume::get(uri.toString());
+        volume->addListener(event_fd);
+        ext.poll_fd = event_fd;
+        return snd_ctl_ext_create(&ext, name, mode);
+    }
+
+    ~SnapcastCtl()
+    {
+        if (volume)
+            volume->removeListener(event_fd);
+        if (event_fd >= 0)
+            close(event_fd);
+        LOG(INFO, LOG_TAG) << "~SnapcastCtl\n";
+    }
+};
+
+
+extern "C"
+{
+    SND_CTL_PLUGIN_DEFINE_FUNC(snapcast)
+    {
+        (void)root;
+        Uri uri{"tcp://127.0.0.1:4953"};
+
+        snd_config_iterator_t i, next;
+        snd_config_for_each(i, next, conf)
+        {
+            snd_config_t* n = snd_config_iterator_entry(i);
+            const char* id;
+            if (snd_config_get_id(n, &id) < 0)
+                continue;
+            if ((strcmp(id, "comment") == 0) || (strcmp(id, "type") == 0) || (strcmp(id, "hint") == 0))
+                continue;
+
+            if (strcmp(id, "uri") == 0)
+            {
+                const char* param = nullptr;
+                if (snd_config_get_string(n, &param) < 0)
+                {
+                    SNDERR("Invalid uri");
+                    return -EINVAL;
+                }
+                uri = Uri(param);
+                if (!uri.port.has_value())
+                    uri.port = 4953;
+                continue;
+            }
+
+            SNDERR("Unknown field %s", id);
+            return -EINVAL;
+        }
+
+        SnapcastCtl* plugin{new (std::nothrow) SnapcastCtl{}};
+        if (!plugin)
+            return -ENOMEM;
+
+        int err{plugin->Initialize(name ? name : "Snapcast CTL", mode, uri)};
+        if (err < 0)
+        {
+            delete plugin;
+            return err;
+        }
+
+        *handlep = plugin->ext.handle;
+        return 0;
+    }
+
+    SND_CTL_PLUGIN_SYMBOL(snapcast);
+}
@@ -0,0 +1,144 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// standard headers
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+/// Preallocated memory for one asio handler at a time, see asio's "allocation" example
+/// Recurring asynchronous operations don't need the heap, unless the memory is in use or too small.
+class HandlerMemory
+{
+public:
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(std::size_t size)
+    {
+        if ((size <= sizeof(storage_)) && !in_use_.exchange(true))
+            return &storage_;
+        ++fallbacks_;
+        return ::operator new(size);
+    }
+
+    void deallocate(void* pointer)
+    {
+        if (pointer == &storage_)
+            in_use_ = false;
+        else
+            ::operator delete(pointer);
+    }
+
+    /// @return number of heap allocations, because the memory was in use or too small
+    std::size_t fallbacks() const
+    {
+        return fallbacks_;
+    }
+
+private:
+    std::aligned_storage_t<1024> storage_;
+    std::atomic_bool in_use_{false};
+    std::atomic<std::size_t> fallbacks_{0};
+};
+
+
+/// Allocator that uses a HandlerMemory
+template <typename T>
+class HandlerAllocator
+{
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(memory)
+    {
+    }
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_)
+    {
+    }
+
+    bool operator==(const HandlerAllocator& other) const noexcept
+    {
+        return &memory_ == &other.memory_;
+    }
+
+    bool operator!=(const HandlerAllocator& other) const noexcept
+    {
+        return &memory_ != &other.memory_;
+    }
+
+    T* allocate(std::size_t n) const
+    {
+        return static_cast<T*>(memory_.allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, std::size_t /*n*/) const
+    {
+        return memory_.deallocate(pointer);
+    }
+
+private:
+    template <typename>
+    friend class HandlerAllocator;
+
+    HandlerMemory& memory_;
+};
+
+
+/// Wraps a handler, so that asio allocates the operation from a HandlerMemory
+template <typename Handler>
+class CustomAllocHandler
+{
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    CustomAllocHandler(HandlerMemory& memory, Handler handler) : memory_(memory), handler_(std::move(handler))
+    {
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type(memory_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args)
+    {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+
+/// @return @p handler, allocated from @p memory
+template <typename Handler>
+inline CustomAllocHandler<Handler> makeCustomAllocHandler(HandlerMemory& memory, Handler handler)
+{
+    return CustomAllocHandler<Handler>(memory, std::move(handler));
+}
@@ -0,0 +1,108 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "histogram.hpp"
+
+// standard headers
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+
+size_t Histogram::bucketOf(uint64_t value)
+{
+    // The first two powers of two are linear
+    if (value < 2 * kSubBuckets)
+        return static_cast<size_t>(value);
+
+    auto msb = static_cast<unsigned>(63 - __builtin_clzll(value));
+    if (msb >= kMaxBits)
+        return kBuckets - 1;
+    unsigned shift = msb - kSubBucketBits;
+    // value >> shift is in [kSubBuckets, 2 * kSubBuckets)
+    return static_cast<size_t>(shift * kSubBuckets + (value >> shift));
+}
+
+
+uint64_t Histogram::highestValueOf(size_t index)
+{
+    if (index < 2 * kSubBuckets)
+        return index;
+
+    unsigned shift = static_cast<unsigned>(index / kSubBuckets) - 1;
+    uint64_t lowest = (index % kSubBuckets + kSubBuckets) << shift;
+    return lowest + (uint64_t{1} << shift) - 1;
+}
+
+
+void Histogram::record(uint64_t value)
+{
+    buckets_[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while ((value > max) && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+        ;
+}
+
+
+uint64_t Histogram::count() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+
+uint64_t Histogram::max() const
+{
+    return max_.load(std::memory_order_relaxed);
+}
+
+
+uint64_t Histogram::percentile(double percentile) const
+{
+    // The buckets are not read atomically as a whole, their sum is used instead of count_
+    std::array<uint64_t, kBuckets> snapshot;
+    uint64_t total = 0;
+    for (size_t n = 0; n < kBuckets; ++n)
+    {
+        snapshot[n] = buckets_[n].load(std::memory_order_relaxed);
+        total += snapshot[n];
+    }
+    if (total == 0)
+        return 0;
+
+    auto rank = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0., 100.) / 100. * static_cast<double>(total)));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t n = 0; n < kBuckets; ++n)
+    {
+        seen += snapshot[n];
+        if (seen >= rank)
+            return std::min(highestValueOf(n), max());
+    }
+    return max();
+}
+
+
+std::string Histogram::toString() const
+{
+    std::ostringstream os;
+    os << "count: " << count() << ", p50: " << percentile(50.) << ", p99: " << percentile(99.)
+       << ", p99.9: " << percentile(99.9) << ", max: " << max();
+    return os.str();
+}
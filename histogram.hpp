@@ -0,0 +1,73 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// standard headers
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+/// Histogram with logarithmic buckets, similar to HdrHistogram
+///
+/// Every power of two is split into kSubBuckets linear buckets, i.e. values are recorded with a relative error of
+/// less than 1 / kSubBuckets. Recording is lock-free and wait-free, so it can be used in the audio callbacks.
+class Histogram
+{
+public:
+    /// Record @p value
+    void record(uint64_t value);
+
+    /// Record @p duration in microseconds, negative durations are recorded as 0
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> duration)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        record(static_cast<uint64_t>(us > 0 ? us : 0));
+    }
+
+    /// @return number of recorded values
+    uint64_t count() const;
+    /// @return largest recorded value
+    uint64_t max() const;
+    /// @return the value below which @p percentile percent of the recorded values are, 0 if empty
+    uint64_t percentile(double percentile) const;
+
+    /// @return "count, p50, p99, p99.9, max" in one line
+    std::string toString() const;
+
+private:
+    /// log2 of the number of linear buckets per power of two
+    static constexpr unsigned kSubBucketBits = 4;
+    static constexpr uint64_t kSubBuckets = 1u << kSubBucketBits;
+    /// values of up to kMaxBits bits are distinguished, larger values go into the last bucket
+    static constexpr unsigned kMaxBits = 36;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBucketBits + 1) * kSubBuckets;
+
+    /// @return index of the bucket for @p value
+    static size_t bucketOf(uint64_t value);
+    /// @return largest value that is recorded in bucket @p index
+    static uint64_t highestValueOf(size_t index);
+
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> max_{0};
+};
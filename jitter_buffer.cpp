@@ -0,0 +1,207 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "jitter_buffer.hpp"
+
+// local headers
+#include "aixlog.hpp"
+
+// standard headers
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sys/mman.h>
+
+
+static constexpr auto LOG_TAG = "JitterBuffer";
+
+using namespace std::chrono;
+
+
+JitterBuffer::JitterBuffer(const SampleFormat& format, milliseconds min_depth, milliseconds max_depth,
+                           size_t capacity)
+    : format_(format), min_frames_(static_cast<size_t>(min_depth.count() * format.msRate())),
+      max_frames_(std::max(min_frames_, static_cast<size_t>(max_depth.count() * format.msRate()))),
+      ring_(std::max({max_frames_, capacity, size_t{1}}) * format.frameSize()), target_frames_(min_frames_)
+{
+    LOG(INFO, LOG_TAG) << "Create JitterBuffer, min: " << min_depth.count() << " ms, max: " << max_depth.count()
+                       << " ms\n";
+}
+
+
+JitterBuffer::~JitterBuffer()
+{
+    if (locked_)
+        munlock(ring_.data(), ring_.size());
+}
+
+
+void JitterBuffer::setStats(std::shared_ptr<Stats> stats)
+{
+    std::scoped_lock lock(mutex_);
+    stats_ = std::move(stats);
+}
+
+
+bool JitterBuffer::lockMemory()
+{
+    std::scoped_lock lock(mutex_);
+    if (!locked_)
+        locked_ = (mlock(ring_.data(), ring_.size()) == 0);
+    return locked_;
+}
+
+
+size_t JitterBuffer::bufferedFrames() const
+{
+    return fill_ / format_.frameSize();
+}
+
+
+void JitterBuffer::consume(char* destination, size_t bytes)
+{
+    size_t first = std::min(bytes, ring_.size() - read_pos_);
+    if (destination != nullptr)
+    {
+        memcpy(destination, ring_.data() + read_pos_, first);
+        memcpy(destination + first, ring_.data(), bytes - first);
+    }
+    read_pos_ = (read_pos_ + bytes) % ring_.size();
+    fill_ -= bytes;
+}
+
+
+void JitterBuffer::updateJitter(size_t size)
+{
+    // The plugin's clock, so that the estimate follows the pacing's time, e.g. a VirtualClock
+    auto now = Clock::instance().now();
+    if (!first_arrival_.has_value())
+        first_arrival_ = now;
+
+    // transit = arrival time - media time. Its variation is caused by the network, since the media is sent in realtime
+    double arrival = duration_cast<microseconds>(now - *first_arrival_).count();
+    double transit = arrival - received_frames_ / format_.usRate();
+    double deviation = std::abs(transit - last_transit_);
+    last_transit_ = transit;
+    jitter_ += (deviation - jitter_) / 16.;
+    received_frames_ += static_cast<double>(size) / format_.frameSize();
+
+    // Keep about three times the jitter buffered on top of the minimum depth
+    auto jitter_frames = static_cast<size_t>(3. * jitter_ * format_.usRate());
+    target_frames_ = std::clamp(min_frames_ + jitter_frames, min_frames_, max_frames_);
+}
+
+
+void JitterBuffer::write(const char* data, size_t size)
+{
+    std::unique_lock lock(mutex_);
+    updateJitter(size);
+
+    // Drop the oldest audio if the buffer is full
+    if (fill_ + size > ring_.size())
+    {
+        size_t overflow = fill_ + size - ring_.size();
+        overflow = std::min(fill_, (overflow + format_.frameSize() - 1) / format_.frameSize() * format_.frameSize());
+        LOG(DEBUG, LOG_TAG) << "Overflow, dropping " << overflow << " bytes\n";
+        consume(nullptr, overflow);
+        if (stats_)
+            stats_->dropped_bytes += overflow;
+        size = std::min(size, ring_.size() - fill_);
+    }
+
+    size_t write_pos = (read_pos_ + fill_) % ring_.size();
+    size_t first = std::min(size, ring_.size() - write_pos);
+    memcpy(ring_.data() + write_pos, data, first);
+    memcpy(ring_.data(), data + first, size - first);
+    fill_ += size;
+
+    // Bring the latency back down if the buffer grew far beyond the target depth
+    size_t frames = bufferedFrames();
+    if (!buffering_ && (frames > 2 * target_frames_ + min_frames_))
+    {
+        size_t drop = frames - target_frames_;
+        LOG(DEBUG, LOG_TAG) << "Buffer too deep: " << frames << " frames, target: " << target_frames_
+                            << ", dropping " << drop << " frames\n";
+        consume(nullptr, drop * format_.frameSize());
+        if (stats_)
+            stats_->dropped_bytes += drop * format_.frameSize();
+    }
+
+    if (buffering_ && (bufferedFrames() >= target_frames_))
+    {
+        LOG(DEBUG, LOG_TAG) << "Buffered " << bufferedFrames() << " frames, jitter: " << jitter_ << " us\n";
+        buffering_ = false;
+    }
+    lock.unlock();
+    cv_.notify_one();
+}
+
+
+size_t JitterBuffer::read(void* destination, size_t frames, microseconds timeout)
+{
+    std::unique_lock lock(mutex_);
+    auto ready = [this, frames]() { return !buffering_ && (bufferedFrames() >= frames); };
+    bool underrun = !cv_.wait_for(lock, timeout, ready);
+    if (underrun && (timeout.count() == 0))
+        return 0;
+
+    auto* out = static_cast<char*>(destination);
+    size_t available = buffering_ ? 0 : std::min(frames, bufferedFrames());
+    consume(out, available * format_.frameSize());
+    // all supported sample formats are signed, i.e. silence is 0
+    memset(out + available * format_.frameSize(), 0, (frames - available) * format_.frameSize());
+
+    if (underrun)
+    {
+        LOG(DEBUG, LOG_TAG) << "Underrun, requested: " << frames << ", available: " << available << "\n";
+        buffering_ = true;
+        if (stats_)
+            ++stats_->underruns;
+    }
+    return frames;
+}
+
+
+void JitterBuffer::clear(size_t capacity)
+{
+    std::scoped_lock lock(mutex_);
+    if (capacity * format_.frameSize() > ring_.size())
+    {
+        if (locked_)
+            munlock(ring_.data(), ring_.size());
+        ring_.assign(capacity * format_.frameSize(), 0);
+        if (locked_)
+            locked_ = (mlock(ring_.data(), ring_.size()) == 0);
+    }
+    read_pos_ = 0;
+    fill_ = 0;
+    buffering_ = true;
+    target_frames_ = min_frames_;
+    first_arrival_ = std::nullopt;
+    received_frames_ = 0;
+    last_transit_ = 0;
+    jitter_ = 0;
+}
+
+
+microseconds JitterBuffer::targetDepth() const
+{
+    std::scoped_lock lock(mutex_);
+    return microseconds(static_cast<int64_t>(target_frames_ / format_.usRate()));
+}
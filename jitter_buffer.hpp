@@ -0,0 +1,106 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// local headers
+#include "clock.hpp"
+#include "sample_format.hpp"
+#include "stats.hpp"
+
+// standard headers
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+
+/// Buffers audio received from the network for capture
+///
+/// The buffer depth adapts to the observed arrival jitter: after an underrun the buffer is refilled up to the target
+/// depth before audio is handed out again, and if the buffer grows far beyond the target, the oldest audio is dropped
+/// to bring the latency back down.
+class JitterBuffer
+{
+public:
+    /// c'tor
+    /// @param format sample format of the received audio
+    /// @param min_depth minimum buffer depth
+    /// @param max_depth maximum buffer depth
+    /// @param capacity minimum capacity in frames, the buffer holds at least @p max_depth
+    JitterBuffer(const SampleFormat& format, std::chrono::milliseconds min_depth, std::chrono::milliseconds max_depth,
+                 size_t capacity = 0);
+    ~JitterBuffer();
+
+    /// Add @p size bytes of received audio (called from the network thread)
+    void write(const char* data, size_t size);
+
+    /// Read @p frames frames into @p destination, waits up to @p timeout for the data to arrive
+    /// If the data doesn't arrive in time, the available frames are padded with silence
+    /// @return number of frames read, 0 if @p timeout is 0 and not enough data is buffered
+    size_t read(void* destination, size_t frames, std::chrono::microseconds timeout);
+
+    /// Drop all buffered audio and start buffering again
+    /// @param capacity grow the buffer to hold at least @p capacity frames
+    void clear(size_t capacity = 0);
+
+    /// Count dropped audio and underruns in @p stats
+    void setStats(std::shared_ptr<Stats> stats);
+
+    /// Lock the buffer into RAM, so that it cannot be paged out
+    /// @return false if locking failed, e.g. because of RLIMIT_MEMLOCK
+    bool lockMemory();
+
+    /// @return current target depth
+    std::chrono::microseconds targetDepth() const;
+
+private:
+    /// @return number of complete buffered frames
+    size_t bufferedFrames() const;
+    /// Remove @p bytes from the front of the ring buffer, copying them into @p destination if not null
+    void consume(char* destination, size_t bytes);
+    /// Update the jitter estimation and the target depth for @p size bytes arriving now
+    void updateJitter(size_t size);
+
+    SampleFormat format_;
+    size_t min_frames_;
+    size_t max_frames_;
+
+    mutable std::mutex mutex_;
+    bool locked_ = false;
+    std::shared_ptr<Stats> stats_;
+    std::condition_variable cv_;
+    std::vector<char> ring_;
+    size_t read_pos_ = 0;
+    size_t fill_ = 0;
+    /// true while (re)filling up to the target depth
+    bool buffering_ = true;
+    size_t target_frames_;
+
+    /// arrival time of the first received byte
+    std::optional<Clock::time_point> first_arrival_;
+    /// received frames since first_arrival_
+    double received_frames_ = 0;
+    /// last transit time (arrival time - media time) in [us]
+    double last_transit_ = 0;
+    /// RFC 3550 style interarrival jitter estimation in [us]
+    double jitter_ = 0;
+};
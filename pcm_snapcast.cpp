@@ -20,10 +20,21 @@
 
 // local headers
 #include "aixlog.hpp"
+#include "audio_packing.hpp"
+#include "channel_mixer.hpp"
+#include "clock.hpp"
+#include "jitter_buffer.hpp"
+#include "protocol.hpp"
+#include "resolver_cache.hpp"
 #include "sample_format.hpp"
+#include "settings.hpp"
+#include "simd.hpp"
 #include "snapstream.hpp"
+#include "stats.hpp"
+#include "stream_pool.hpp"
 #include "string_utils.hpp"
 #include "uri.hpp"
+#include "volume.hpp"
 
 // 3rd party headers
 #include <alsa/asoundlib.h>
@@ -33,17 +44,32 @@
 #include <alsa/pcm_ioplug.h>
 
 // standard headers
+#include <array>
+#include <cerrno>
 #include <chrono>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <initializer_list>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
 #include <thread>
+#include <utility>
+#include <vector>
 
 
 static constexpr auto LOG_TAG = "SnapcastPCM";
 
+/// Maximum number of channels accepted from ALSA clients
+static constexpr uint16_t kMaxChannels = 8;
+/// Transfer calls that wake up later than this after their deadline are counted as late
+static constexpr auto kLateWakeup = std::chrono::milliseconds(2);
+
 
 /// An ALSA PCM I/O plugin that uses SnapStream for forwarding audio to Snapserver
 class SnapcastPcm
@@ -51,9 +77,126 @@ class SnapcastPcm
 private:
     std::mutex mutex;
     std::shared_ptr<SnapStream> stream;
-    Uri uri;
-    int64_t written;
-    std::chrono::time_point<std::chrono::steady_clock> next{std::chrono::seconds(0)};
+    Settings settings;
+    /// channel layout of the client, as set by set_chmap
+    ChannelLayout chmap;
+    /// mixes the client's channels into the server's channels
+    ChannelMixer mixer;
+    /// mixer has been configured by Prepare, and must be reconfigured if the client's layout changes
+    bool mixer_configured{false};
+    /// playback volume, set by the server or the ctl plugin
+    std::shared_ptr<Volume> volume;
+    /// the client's channels in the current transfer
+    std::array<ChannelArea, kMaxChannels> areas;
+    /// mixed audio in the server's sample format
+    std::vector<uint8_t> buffer;
+    /// audio received from the server, for capture
+    std::unique_ptr<JitterBuffer> jitter;
+    /// counters of the stream
+    std::shared_ptr<Stats> stats;
+    /// writes stats periodically, if configured
+    std::unique_ptr<StatsFile> statsfile;
+    int64_t written{0};
+    /// the timeline is interrupted, the next Transfer sends a position message
+    bool discontinuity{true};
+    /// reconnects of the stream when the last position message was sent
+    uint64_t reconnects{0};
+    /// Drain has sent all audio, ALSA stops the stream afterwards
+    bool drained{false};
+    /// the stream is paused, it must be resumed before it is dropped or returned to the pool
+    bool paused{false};
+    /// deadline of the next Transfer, according to Clock::instance()
+    Clock::time_point next{std::chrono::seconds(0)};
+    /// region of buffer that is locked into RAM
+    std::pair<uint8_t*, size_t> locked_buffer{nullptr, 0};
+#ifndef NDEBUG
+    /// transfers since Prepare and the stream's allocations after the last one, for checking the steady state
+    size_t transfers{0};
+    size_t allocations{0};
+#endif
+
+    /// @return a new stream, with the handlers for the direction of the pcm
+    std::shared_ptr<SnapStream> createStream()
+    {
+        auto result = std::make_shared<SnapStream>(settings.uri, settings.protocol);
+        result->setThreadSettings(settings.thread);
+        // Backpressure as soon as about 20 ms are buffered
+        if (settings.pacing == Pacing::server)
+            result->setSendBufferSize(static_cast<int>(settings.sampleformat.msRate() * 20) *
+                                      static_cast<int>(settings.sampleformat.frameSize()));
+        if (!jitter && settings.packing)
+            result->setPacking(settings.sampleformat);
+        if (jitter && (settings.protocol == Protocol::snapstream))
+        {
+            // Packed audio is restored in unpacked, which grows to the largest message once
+            result->setMessageHandler(
+                [jitter = jitter.get(), format = settings.sampleformat,
+                 unpacked = std::vector<char>()](const msg::Header& header, const char* payload) mutable
+            {
+                if (header.type != static_cast<uint16_t>(msg::Type::audio))
+                    return;
+                if (header.flags == 0)
+                {
+                    jitter->write(payload, header.size);
+                    return;
+                }
+                unpacked.resize(packing::unpackedSize(header.size, format, header.flags));
+                packing::unpack(payload, header.size, format, header.flags, unpacked.data());
+                jitter->write(unpacked.data(), unpacked.size());
+            });
+        }
+        else if (jitter)
+        {
+            result->setDataHandler([jitter = jitter.get()](const char* data, size_t size)
+            { jitter->write(data, size); });
+        }
+        else
+        {
+            result->setMessageHandler([volume = volume](const msg::Header& header, const char* payload)
+            {
+                if ((header.type != static_cast<uint16_t>(msg::Type::volume)) || (header.size < sizeof(msg::Volume)))
+                    return;
+                msg::Volume message;
+                memcpy(&message, payload, sizeof(message));
+                LOG(INFO, LOG_TAG) << "Volume: " << message.percent << ", muted: " << message.muted << "\n";
+                volume->setPercent(message.percent);
+                volume->setMuted(message.muted != 0);
+            });
+        }
+        return result;
+    }
+
+    /// Preallocate the buffers of the audio path for @p ext's buffer size, so that Transfer doesn't allocate
+    void reserveMemory(const snd_pcm_ioplug_t* ext)
+    {
+        if (ext->stream == SND_PCM_STREAM_CAPTURE)
+        {
+            if (settings.mlock && !jitter->lockMemory())
+                LOG(WARNING, LOG_TAG) << "Failed to lock the jitter buffer, RLIMIT_MEMLOCK might be too low\n";
+            return;
+        }
+
+        // a full buffer in periods, plus markers and the message being written
+        stream->reserve(ext->buffer_size / ext->period_size + 2, buffer.size(), settings.mlock);
+        if (settings.mlock && (locked_buffer != std::make_pair(buffer.data(), buffer.size())))
+        {
+            unlockBuffer();
+            if (mlock(buffer.data(), buffer.size()) == 0)
+                locked_buffer = {buffer.data(), buffer.size()};
+            else
+                LOG(WARNING, LOG_TAG) << "Failed to lock the mixer buffer: " << strerror(errno) << "\n";
+        }
+#ifndef NDEBUG
+        transfers = 0;
+#endif
+    }
+
+    void unlockBuffer()
+    {
+        if (locked_buffer.first != nullptr)
+            munlock(locked_buffer.first, locked_buffer.second);
+        locked_buffer = {nullptr, 0};
+    }
 
     static int Start(snd_pcm_ioplug_t* ext)
     {
@@ -82,43 +225,17 @@ private:
         if (!self->stream)
             return -EBADFD;
 
-        // self->stream->stop();
-        // oboe::StreamState state{self->stream->getState()};
-        // if (state == oboe::StreamState::Stopped || state == oboe::StreamState::Flushed)
-        //     return 0; // We don't need to do anything if the stream is already stopped.
-
-        // oboe::Result result{self->stream->requestPause()};
-        // if (result != oboe::Result::OK) {
-        //     std::cerr << "[ALSA Oboe] Failed to pause stream: " << oboe::convertToText(result) << std::endl;
-        //     return -1;
-        // }
-
-        // state = self->stream->getState();
-        // while (state != oboe::StreamState::Paused) {
-        //     // AAudio documentation states that requestFlush() is valid while the stream is Pausing.
-        //     // However, in practice it returns InvalidState, so we'll just wait for the stream to pause.
-        //     result = self->stream->waitForStateChange(state, &state, TimeoutNanoseconds);
-        //     if (result != oboe::Result::OK) {
-        //         std::cerr << "[ALSA Oboe] Failed to wait for pause: " << oboe::convertToText(result) << std::endl;
-        //         return -1;
-        //     }
-        // }
-
-        // result = self->stream->requestFlush();
-        // if (result != oboe::Result::OK) {
-        //     std::cerr << "[ALSA Oboe] Failed to flush stream: " << oboe::convertToText(result) << std::endl;
-        //     return -1;
-        // }
-
-        // state = self->stream->getState();
-        // while (state != oboe::StreamState::Flushed) {
-        //     result = self->stream->waitForStateChange(oboe::StreamState::Flushing, &state, TimeoutNanoseconds);
-        //     if (result != oboe::Result::OK) {
-        //         std::cerr << "[ALSA Oboe] Failed to wait for flush: " << oboe::convertToText(result) << std::endl;
-        //         return -1;
-        //     }
-        // }
-
+        // Dropped audio must not be played, e.g. after seeking. Stopping after a drain drops nothing.
+        if (self->jitter)
+            self->jitter->clear();
+        else if (!self->drained)
+            self->stream->flush();
+        // Dropping a paused stream doesn't resume it, the receiver would keep holding its buffer
+        if (self->paused)
+            self->stream->pause(false);
+        self->paused = false;
+        self->next = Clock::time_point(std::chrono::seconds(0));
+        self->discontinuity = true;
         return 0;
     }
 
@@ -140,14 +257,67 @@ private:
 
         // We don't care about the device ring buffer position as Oboe handles writing samples to it.
         // Instead, we just need to return the current position relative to the imaginary ALSA buffer size.
+        // For capture, one period is always reported as available, Transfer waits for the data to arrive.
         auto res = self->written % ext->buffer_size;
+        if (ext->stream == SND_PCM_STREAM_CAPTURE)
+            res = (self->written + ext->period_size) % ext->buffer_size;
         LOG(DEBUG, LOG_TAG) << "Pointer, return: " << res << "\n";
         return res;
     }
 
+    static snd_pcm_sframes_t Capture(snd_pcm_ioplug_t* ext, const snd_pcm_channel_area_t* areas,
+                                     snd_pcm_uframes_t offset, snd_pcm_uframes_t size)
+    {
+        auto* self{static_cast<SnapcastPcm*>(ext->private_data)};
+        std::unique_lock lock{self->mutex};
+        LOG(DEBUG, LOG_TAG) << "Capture, offset: " << offset << ", size: " << size << ", non-block: " << ext->nonblock
+                            << "\n";
+        if (!self->stream || !self->jitter)
+            return -EBADFD;
+
+        if (size == 0)
+            return 0;
+
+        self->stream->start();
+
+        auto& area{areas[0]};
+        auto* address{static_cast<uint8_t*>(area.addr) + (area.first + offset * area.step) / 8};
+        std::chrono::microseconds timeout{0};
+        if (ext->nonblock == 0)
+            timeout = self->settings.jitter_max + std::chrono::microseconds(size * 1000000 / ext->rate);
+
+        // Don't block Pointer while waiting for the data to arrive
+        // Received audio that has to be converted into the client's format is read into the mixer buffer first
+        auto* jitter{self->jitter.get()};
+        bool convert{!self->mixer.isPassthrough()};
+        auto* received{convert ? self->buffer.data() : address};
+        lock.unlock();
+        auto frames{jitter->read(received, size, timeout)};
+        // A blocking read pads missing audio with silence after the timeout, only a non-blocking read returns 0
+        if ((frames == 0) && (ext->nonblock != 0))
+            return -EAGAIN;
+
+        lock.lock();
+        if (convert)
+        {
+            auto channels{self->settings.sampleformat.channels()};
+            auto sample_size{self->settings.sampleformat.sampleSize()};
+            for (uint16_t c{0}; c < channels; ++c)
+                self->areas[c] = {received + c * sample_size, channels};
+            self->mixer.mix(self->areas.data(), address, frames);
+        }
+        self->written += frames;
+        self->stats->frames.fetch_add(frames, std::memory_order_relaxed);
+        return frames;
+    }
+
     static snd_pcm_sframes_t Transfer(snd_pcm_ioplug_t* ext, const snd_pcm_channel_area_t* areas,
                                       snd_pcm_uframes_t offset, snd_pcm_uframes_t size)
     {
+        if (ext->stream == SND_PCM_STREAM_CAPTURE)
+            return Capture(ext, areas, offset, size);
+
+        auto start{std::chrono::steady_clock::now()};
         auto* self{static_cast<SnapcastPcm*>(ext->private_data)};
         std::unique_lock lock{self->mutex};
         LOG(DEBUG, LOG_TAG) << "Transfer, offset: " << offset << ", size: " << size << ", non-block: " << ext->nonblock
@@ -159,6 +329,17 @@ private:
             return 0;
 
         self->stream->start();
+        self->drained = false;
+        self->stats->frames.fetch_add(size, std::memory_order_relaxed);
+
+        // Without realtime pacing, e.g. when rendering offline, wait for the server instead of dropping audio
+        if ((self->settings.pacing != Pacing::realtime) && !self->stats->connected)
+        {
+            auto stream{self->stream};
+            lock.unlock();
+            stream->waitForConnection(self->settings.drain_timeout);
+            lock.lock();
+        }
 
         // if (self->stream->getState() != oboe::StreamState::Started) {
         //     // ALSA expects us to automatically start the stream if it's not started.
@@ -169,37 +350,96 @@ private:
         //     }
         // }
 
-        auto& firstArea{areas[0]};
-        auto* address{reinterpret_cast<uint8_t*>(firstArea.addr)};
+        // The volume is applied by the mixer, a changed gain is folded into its matrix
+        auto gain{self->volume->gain()};
+        if (gain != self->mixer.gain())
+            self->mixer.setGain(gain);
 
-        self->stream->write(address, size * 4);
-
-        auto now = std::chrono::steady_clock::now();
-        if (self->next == std::chrono::time_point<std::chrono::steady_clock>(std::chrono::seconds(0)))
+        // Tell the receiver where the timeline continues: after opening, a flush, a pause or a reconnect
+        auto reconnects{self->stats->reconnects.load(std::memory_order_relaxed)};
+        if ((self->discontinuity || (reconnects != self->reconnects)) && self->stats->connected)
         {
-            self->next = now;
+            msg::Position position{static_cast<uint64_t>(self->written)};
+            self->stream->writeMessage(msg::Type::position, &position, sizeof(position));
+            self->discontinuity = false;
+            self->reconnects = reconnects;
         }
-        double sec = static_cast<double>(size) / static_cast<double>(ext->rate);
-        self->next += std::chrono::microseconds(static_cast<int64_t>(sec * 1000 * 1000));
 
-        // When using MPD, non-block is true, but seems to be required
-        // if (ext->nonblock == 0)
+        auto bytes{size * self->settings.sampleformat.frameSize()};
+        auto sampleBits{self->settings.format.sampleSize() * 8u};
+        if (self->mixer.isPassthrough() &&
+            ((ext->access == SND_PCM_ACCESS_RW_INTERLEAVED) || (ext->access == SND_PCM_ACCESS_MMAP_INTERLEAVED)))
+        {
+            auto& area{areas[0]};
+            self->stream->write(static_cast<const uint8_t*>(area.addr) + (area.first + offset * area.step) / 8, bytes);
+        }
+        else
         {
-            std::this_thread::sleep_for(self->next - now);
+            for (unsigned int c{0}; c < ext->channels; ++c)
+            {
+                auto& area{areas[c]};
+#ifndef NDEBUG
+                if ((area.first % sampleBits != 0) || (area.step % sampleBits != 0))
+                {
+                    LOG(ERROR, LOG_TAG) << "[ALSA Snapcast] Attempt to transfer unaligned samples\n";
+                    return -EINVAL;
+                }
+#endif
+                self->areas[c].address = static_cast<const uint8_t*>(area.addr) + (area.first + offset * area.step) / 8;
+                self->areas[c].stride = area.step / sampleBits;
+            }
+
+            if (self->buffer.size() < bytes)
+                self->buffer.resize(bytes);
+            self->mixer.mix(self->areas.data(), self->buffer.data(), size);
+            self->stream->write(self->buffer.data(), bytes);
         }
 
 #ifndef NDEBUG
-        uint channelOffset{0};
-        for (unsigned int c{0}; c < ext->channels; ++c)
+        // After warming up, the audio path must not allocate anymore
+        static constexpr size_t kWarmupTransfers = 8;
+        auto allocations{self->stream->allocations()};
+        if ((++self->transfers > kWarmupTransfers) && (allocations != self->allocations))
+            LOG(ERROR, LOG_TAG) << "Heap allocations in the steady state: " << allocations - self->allocations << "\n";
+        self->allocations = allocations;
+#endif
+
+        // The processing time is real, even if the pacing is simulated
+        self->stats->transfer_us.record(std::chrono::steady_clock::now() - start);
+        if ((self->settings.pacing != Pacing::realtime) && self->stats->connected)
+        {
+            // The socket's backpressure paces the client, a stalled server blocks it for at most drain_timeout
+            auto messages{(self->settings.pacing == Pacing::server) ? size_t{1} : ext->buffer_size / ext->period_size};
+            auto stream{self->stream};
+            self->next = Clock::time_point(std::chrono::seconds(0));
+            lock.unlock();
+            stream->waitForQueue(messages, self->settings.drain_timeout);
+            lock.lock();
+        }
+        else
         {
-            auto& area{areas[c]};
-            if (area.addr != firstArea.addr || area.step != firstArea.step || area.first >= firstArea.step)
+            // Without a connection, audio is dropped in realtime instead of as fast as possible
+            auto& clock{Clock::instance()};
+            auto now{clock.now()};
+            if (self->next == Clock::time_point(std::chrono::seconds(0)))
             {
-                LOG(ERROR, LOG_TAG) << "[ALSA Snapcast] Attempt to transfer non-interleaved samples\n";
-                return -1;
+                self->next = now;
             }
+            double sec = static_cast<double>(size) / static_cast<double>(ext->rate);
+            self->next += std::chrono::microseconds(static_cast<int64_t>(sec * 1000 * 1000));
+
+            // When using MPD, non-block is true, but seems to be required
+            // if (ext->nonblock == 0)
+            // Don't block Pointer while pacing, Stop might reset next meanwhile
+            auto deadline{self->next};
+            lock.unlock();
+            clock.sleepUntil(deadline);
+            lock.lock();
+            auto lateness{clock.now() - deadline};
+            self->stats->pacing_us.record(lateness);
+            if (lateness > kLateWakeup)
+                self->stats->late_wakeups.fetch_add(1, std::memory_order_relaxed);
         }
-#endif
 
         // oboe::ResultWithValue<int32_t> result{self->stream->write(address, size, ext->nonblock ? 0 :
         // TimeoutNanoseconds)}; if (result != oboe::Result::OK) {
@@ -222,10 +462,26 @@ private:
         if (ext->private_data)
         {
             auto* self{static_cast<SnapcastPcm*>(ext->private_data)};
-            if (self->stream)
+            if (self->stats)
+                LOG(INFO, LOG_TAG) << "Latencies in us\n" << self->stats->latencies();
+            if (self->stream && (ext->stream == SND_PCM_STREAM_PLAYBACK) && (self->settings.pool_grace.count() > 0))
+            {
+                std::optional<SampleFormat> silence;
+                if (self->settings.pool_silence)
+                    silence = self->settings.sampleformat;
+                // The next user of the pooled stream starts unpaused
+                if (self->paused)
+                    self->stream->pause(false);
+                StreamPool::instance().release(self->poolKey(), std::move(self->stream), self->settings.pool_grace,
+                                               silence);
+            }
+            else if (self->stream)
+            {
                 self->stream->stop();
-            delete self;
+            }
+            // ext is a member of self
             ext->private_data = nullptr;
+            delete self;
         }
         return 0;
     }
@@ -243,10 +499,39 @@ private:
         //     ->setSampleRateConversionQuality(oboe::SampleRateConversionQuality::Medium)
         //     ->setBufferCapacityInFrames(ext->buffer_size)
 
-        if (self->stream)
-            return 0;
+        const auto& format{self->settings.format};
+        const auto& wireformat{self->settings.sampleformat};
+        if (ext->stream == SND_PCM_STREAM_CAPTURE)
+        {
+            // The buffer must hold at least the client's buffer, otherwise a read would never be satisfied
+            if (self->jitter)
+                self->jitter->clear(ext->buffer_size);
+            else
+                self->jitter = std::make_unique<JitterBuffer>(wireformat, self->settings.jitter_min,
+                                                              self->settings.jitter_max, ext->buffer_size);
+        }
 
-        self->stream = std::make_shared<SnapStream>(self->uri);
+        int err{self->configureMixer(ext)};
+        if (err < 0)
+            return err;
+        if ((ext->stream == SND_PCM_STREAM_PLAYBACK) || !self->mixer.isPassthrough())
+            self->buffer.resize(ext->buffer_size * wireformat.frameSize());
+
+        // A connection of a previously closed playback device is reused with its handlers
+        if (!self->stream && (ext->stream == SND_PCM_STREAM_PLAYBACK))
+            self->stream = StreamPool::instance().acquire(self->poolKey());
+        if (!self->stream)
+            self->stream = self->createStream();
+        self->reserveMemory(ext);
+        self->discontinuity = true;
+
+        self->stats = self->stream->stats();
+        if (self->jitter)
+            self->jitter->setStats(self->stats);
+        if (!self->settings.statsfile.empty() && !self->statsfile)
+            self->statsfile = std::make_unique<StatsFile>(self->settings.statsfile, self->stats,
+                                                          self->settings.sampleformat.frameSize(),
+                                                          self->settings.stats_interval);
         return 0;
 
         // oboe::AudioStreamBuilder builder;
@@ -296,85 +581,169 @@ private:
     static int Drain(snd_pcm_ioplug_t* ext)
     {
         auto self{static_cast<SnapcastPcm*>(ext->private_data)};
-        std::scoped_lock lock{self->mutex};
+        std::unique_lock lock{self->mutex};
         LOG(INFO, LOG_TAG) << "Drain\n";
-        // if (!self->stream)
-        //     return -EBADFD;
-
-        // // We need to wait for the stream to read all samples during a drain.
-        // // According to AAudio documentation, requestStop() guarantees that the stream's contents have been written
-        // to the device.
-        // // However, in practice it doesn't seem to be the case, so we'll just poll the frames read until it reaches
-        // the frames written.
-
-        // struct timespec start;
-        // clock_gettime(CLOCK_MONOTONIC, &start);
-        // start.tv_sec += 1;
-
-        // while (true) {
-        //     int64_t framesRead{self->stream->getFramesRead()};
-        //     if (framesRead < 0) {
-        //         std::cerr << "[ALSA Oboe] Failed to get frames read: " << framesRead << std::endl;
-        //         return -1;
-        //     }
+        if (!self->stream)
+            return -EBADFD;
 
-        //     int64_t framesWritten{self->stream->getFramesWritten()};
-        //     if (framesWritten < 0) {
-        //         std::cerr << "[ALSA Oboe] Failed to get frames written: " << framesWritten << std::endl;
-        //         return -1;
-        //     }
+        if (ext->stream == SND_PCM_STREAM_CAPTURE)
+            return 0;
 
-        //     if (framesRead == framesWritten)
-        //         break;
+        // Transfer has handed all audio to the stream, wait for it to be sent. Don't block Pointer meanwhile.
+        self->drained = true;
+        auto stream{self->stream};
+        lock.unlock();
+        if (!stream->drain(self->settings.drain_timeout))
+            LOG(WARNING, LOG_TAG) << "Drain timed out after " << self->settings.drain_timeout.count() << " ms\n";
+        return 0;
+    }
 
-        //     usleep(1000);
+    static int Pause(snd_pcm_ioplug_t* ext, int enable)
+    {
+        auto self{static_cast<SnapcastPcm*>(ext->private_data)};
+        std::scoped_lock lock{self->mutex};
+        LOG(INFO, LOG_TAG) << "Pause, enable: " << enable << "\n";
+        if (!self->stream)
+            return -EBADFD;
 
-        //     struct timespec now;
-        //     clock_gettime(CLOCK_MONOTONIC, &now);
-        //     if ((now.tv_sec > start.tv_sec || (now.tv_sec == start.tv_sec && now.tv_nsec > start.tv_nsec)) &&
-        //     framesRead == 0) {
-        //         // AAudio has a bug where it won't read any samples until an arbitrary minimum amount of samples have
-        //         been written.
-        //         // We just wait for a second and if no samples have been read, we'll assume that AAudio is broken.
-        //         break;
-        //     }
-        // }
+        // The pointer doesn't move while paused, since nothing is transferred
+        self->stream->pause(enable != 0);
+        self->paused = (enable != 0);
+        if (enable == 0)
+        {
+            // Restart the pacing instead of catching up on the paused time, and drop audio received meanwhile
+            self->next = Clock::time_point(std::chrono::seconds(0));
+            self->discontinuity = true;
+            if (self->jitter)
+                self->jitter->clear();
+        }
+        return 0;
+    }
 
-        // oboe::Result result{self->stream->requestStop()};
-        // if (result != oboe::Result::OK) {
-        //     std::cerr << "[ALSA Oboe] Failed to stop stream: " << oboe::convertToText(result) << std::endl;
-        //     return -1;
-        // }
+    static snd_pcm_chmap_query_t** QueryChmaps(snd_pcm_ioplug_t* /*ext*/)
+    {
+        // The caller frees the maps with snd_pcm_free_chmaps
+        auto** maps{static_cast<snd_pcm_chmap_query_t**>(calloc(kMaxChannels + 1, sizeof(snd_pcm_chmap_query_t*)))};
+        if (!maps)
+            return nullptr;
 
-        // oboe::StreamState state{self->stream->getState()};
-        // while (state != oboe::StreamState::Stopped) {
-        //     result = self->stream->waitForStateChange(state, &state, TimeoutNanoseconds);
-        //     if (result != oboe::Result::OK) {
-        //         std::cerr << "[ALSA Oboe] Failed to wait for stop: " << oboe::convertToText(result) << std::endl;
-        //         return -1;
-        //     }
-        // }
+        for (uint16_t channels{1}; channels <= kMaxChannels; ++channels)
+        {
+            auto* map{static_cast<snd_pcm_chmap_query_t*>(
+                malloc(sizeof(snd_pcm_chmap_query_t) + channels * sizeof(unsigned int)))};
+            if (!map)
+            {
+                snd_pcm_free_chmaps(maps);
+                return nullptr;
+            }
+            // Any permutation of the default positions can be mixed into the server's layout
+            map->type = SND_CHMAP_TYPE_VAR;
+            map->map.channels = channels;
+            auto layout{ChannelMixer::defaultLayout(channels)};
+            for (uint16_t c{0}; c < channels; ++c)
+                map->map.pos[c] = static_cast<unsigned int>(layout[c]);
+            maps[channels - 1] = map;
+        }
+        return maps;
+    }
 
-        return 0;
+    static snd_pcm_chmap_t* GetChmap(snd_pcm_ioplug_t* ext)
+    {
+        auto* self{static_cast<SnapcastPcm*>(ext->private_data)};
+        std::scoped_lock lock{self->mutex};
+        auto layout{self->clientLayout(ext->channels)};
+
+        // The caller frees the map
+        auto* map{
+            static_cast<snd_pcm_chmap_t*>(malloc(sizeof(snd_pcm_chmap_t) + layout.size() * sizeof(unsigned int)))};
+        if (!map)
+            return nullptr;
+        map->channels = layout.size();
+        for (size_t c{0}; c < layout.size(); ++c)
+            map->pos[c] = static_cast<unsigned int>(layout[c]);
+        return map;
     }
 
-    static int Pause(snd_pcm_ioplug_t* ext, int enable)
+    static int SetChmap(snd_pcm_ioplug_t* ext, const snd_pcm_chmap_t* map)
     {
-        auto self{static_cast<SnapcastPcm*>(ext->private_data)};
+        auto* self{static_cast<SnapcastPcm*>(ext->private_data)};
         std::scoped_lock lock{self->mutex};
-        LOG(INFO, LOG_TAG) << "Pause, enable: " << enable << "\n";
-        // if (!self->stream)
-        //     return -EBADFD;
+        LOG(INFO, LOG_TAG) << "SetChmap, channels: " << map->channels << "\n";
+        if ((map->channels < 1) || (map->channels > kMaxChannels) || (map->channels != ext->channels))
+            return -EINVAL;
 
-        // oboe::Result result{self->stream->requestPause()};
-        // if (result != oboe::Result::OK) {
-        //     std::cerr << "[ALSA Oboe] Failed to pause stream: " << oboe::convertToText(result) << std::endl;
-        //     return -1;
-        // }
+        ChannelLayout previous{std::move(self->chmap)};
+        self->chmap.clear();
+        for (unsigned int c{0}; c < map->channels; ++c)
+        {
+            auto position{map->pos[c] & SND_CHMAP_POSITION_MASK};
+            if (position > static_cast<unsigned int>(ChannelPosition::tc))
+                position = static_cast<unsigned int>(ChannelPosition::unknown);
+            self->chmap.push_back(static_cast<ChannelPosition>(position));
+        }
 
+        // After Prepare, the mixer has to follow the new layout right away
+        if (!self->mixer_configured)
+            return 0;
+        int err{self->configureMixer(ext)};
+        if (err < 0)
+            self->chmap = std::move(previous);
+        return err;
+    }
+
+    /// Configure mixer for the client's format and channel layout, mutex must be locked
+    /// @return 0 or a negative error code
+    int configureMixer(snd_pcm_ioplug_t* ext)
+    {
+        const auto& format{settings.format};
+        const auto& wireformat{settings.sampleformat};
+        try
+        {
+            // Playback mixes the client's channels into the server's, capture converts the received audio if the
+            // client's format differs from the wire format
+            if (ext->stream == SND_PCM_STREAM_PLAYBACK)
+                mixer.configure(format.encoding(), clientLayout(ext->channels), wireformat.encoding(), settings.chmap,
+                                settings.ttable);
+            else if (ext->channels == wireformat.channels())
+                mixer.configure(wireformat.encoding(), settings.chmap, format.encoding(), settings.chmap);
+            else if (wireformat.channels() <= kMaxChannels)
+                mixer.configure(wireformat.encoding(), settings.chmap, format.encoding(), clientLayout(ext->channels));
+            else
+                throw std::invalid_argument("too many channels to convert: " + std::to_string(wireformat.channels()));
+        }
+        catch (const std::exception& e)
+        {
+            LOG(ERROR, LOG_TAG) << "Failed to configure the channel mixer: " << e.what() << "\n";
+            return -EINVAL;
+        }
+        mixer.setDither(settings.dither);
+        mixer.setNoiseShaping(settings.noiseshaping);
+        mixer_configured = true;
+        LOG(INFO, LOG_TAG) << "Channel mixer: " << mixer.toString() << ", simd: " << simd::toString(simd::active())
+                           << "\n";
         return 0;
     }
 
+    /// @return key of this device's connection in the StreamPool
+    std::string poolKey() const
+    {
+        // Everything that createStream applies to the stream, a pooled stream must be interchangeable with a new one
+        static constexpr std::array<const char*, 3> pacings{"none", "realtime", "server"};
+        return settings.uri.toString() + "|" + (settings.protocol == Protocol::raw ? "raw" : "snapstream") + "|" +
+               settings.sampleformat.toString() + (settings.packing ? "|packed" : "") + "|" +
+               pacings[static_cast<size_t>(settings.pacing)] + "|" + settings.thread.toString() +
+               (settings.mlock ? "|mlock" : "") + "|" + std::to_string(settings.jitter_min.count()) + ":" +
+               std::to_string(settings.jitter_max.count());
+    }
+
+    /// @return the client's channel layout as set by set_chmap, or the default layout for @p channels
+    ChannelLayout clientLayout(unsigned int channels) const
+    {
+        if (chmap.size() == channels)
+            return chmap;
+        return ChannelMixer::defaultLayout(channels);
+    }
+
     constexpr static snd_pcm_ioplug_callback_t Callbacks{
         .start = &Start,
         .stop = &Stop,
@@ -385,6 +754,9 @@ private:
         .drain = &Drain,
         .pause = &Pause,
         .resume = &Start,
+        .query_chmaps = &QueryChmaps,
+        .get_chmap = &GetChmap,
+        .set_chmap = &SetChmap,
     };
 
 public:
@@ -401,15 +773,19 @@ public:
         LOG(INFO, LOG_TAG) << "Create SnapcastPcm\n";
     }
 
-    int Initialize(const char* name, snd_pcm_stream_t stream, int mode, const SampleFormat& sampleformat,
-                   const Uri& uri)
+    int Initialize(const char* name, snd_pcm_stream_t stream, int mode, const Settings& settings)
     {
+        const auto& sampleformat{settings.format};
         LOG(INFO, LOG_TAG) << "Initialize name: " << name << ", mode: " << mode
-                           << ", sample format: " << sampleformat.toString() << ", uri: " << uri.toString() << "\n";
-        this->uri = uri;
+                           << ", sample format: " << sampleformat.toString()
+                           << ", wire format: " << settings.sampleformat.toString()
+                           << ", uri: " << settings.uri.toString() << "\n";
+        this->settings = settings;
+        // The configured volume is the initial one, it must not reset the volume of other open instances
+        volume = Volume::get(settings.uri.toString(), settings.volume.value_or(100));
 
-        if (stream != SND_PCM_STREAM_PLAYBACK)
-            return -EINVAL; // We only support playback for now.
+        if ((stream != SND_PCM_STREAM_PLAYBACK) && (stream != SND_PCM_STREAM_CAPTURE))
+            return -EINVAL;
 
         int err{snd_pcm_ioplug_create(&plug, name, stream, mode)};
         if (err < 0)
@@ -418,37 +794,51 @@ public:
         auto setParamList{[io = &plug](int type, std::initializer_list<unsigned int> list)
         { return snd_pcm_ioplug_set_param_list(io, type, list.size(), list.begin()); }};
 
-        err = setParamList(SND_PCM_IOPLUG_HW_ACCESS, {SND_PCM_ACCESS_RW_INTERLEAVED});
+        // Non-interleaved access is interleaved while mixing into the server's channels
+        if (stream == SND_PCM_STREAM_CAPTURE)
+            err = setParamList(SND_PCM_IOPLUG_HW_ACCESS,
+                               {SND_PCM_ACCESS_RW_INTERLEAVED, SND_PCM_ACCESS_MMAP_INTERLEAVED});
+        else
+            err = setParamList(SND_PCM_IOPLUG_HW_ACCESS,
+                               {SND_PCM_ACCESS_RW_INTERLEAVED, SND_PCM_ACCESS_RW_NONINTERLEAVED,
+                                SND_PCM_ACCESS_MMAP_INTERLEAVED, SND_PCM_ACCESS_MMAP_NONINTERLEAVED});
         if (err < 0)
             return err;
 
         _snd_pcm_format format = SND_PCM_FORMAT_S16_LE;
-        switch (sampleformat.bits())
+        switch (sampleformat.encoding())
         {
-            case 8:
+            case SampleEncoding::s8:
                 format = SND_PCM_FORMAT_S8;
                 break;
-            case 16:
+            case SampleEncoding::s16le:
                 format = SND_PCM_FORMAT_S16_LE;
                 break;
-            case 24:
+            case SampleEncoding::s24_3le:
+                format = SND_PCM_FORMAT_S24_3LE;
+                break;
+            case SampleEncoding::s24_4le:
                 format = SND_PCM_FORMAT_S24_LE;
                 break;
-            case 32:
+            case SampleEncoding::s32le:
                 format = SND_PCM_FORMAT_S32_LE;
                 break;
-            default: // TODO: error handling
-                format = SND_PCM_FORMAT_S16_LE;
+            case SampleEncoding::f32le:
+                format = SND_PCM_FORMAT_FLOAT_LE;
+                break;
         }
 
         err = setParamList(SND_PCM_IOPLUG_HW_FORMAT, {static_cast<unsigned int>(format)});
         if (err < 0)
             return err;
 
-        // We could support more than 2 channels, but it's fairly complicated due to channel mappings.
-        // err = snd_pcm_ioplug_set_param_minmax(&plug, SND_PCM_IOPLUG_HW_CHANNELS, 1, 2);
-        err = snd_pcm_ioplug_set_param_minmax(&plug, SND_PCM_IOPLUG_HW_CHANNELS, sampleformat.channels(),
-                                              sampleformat.channels());
+        // Any number of client channels is mixed into the server's channels, based on the channel maps.
+        // Captured audio is passed as received, or mixed into the channels of the format.
+        if (stream == SND_PCM_STREAM_CAPTURE)
+            err = snd_pcm_ioplug_set_param_minmax(&plug, SND_PCM_IOPLUG_HW_CHANNELS, sampleformat.channels(),
+                                                  sampleformat.channels());
+        else
+            err = snd_pcm_ioplug_set_param_minmax(&plug, SND_PCM_IOPLUG_HW_CHANNELS, 1, kMaxChannels);
         if (err < 0)
             return err;
 
@@ -475,10 +865,52 @@ public:
     {
         std::scoped_lock lock{mutex};
         stream.reset();
+        unlockBuffer();
         LOG(INFO, LOG_TAG) << "~SnapcastPcm\n";
     }
 };
 
+/// Parse a route plugin style transfer table: ttable.<client channel>.<server channel> <gain>
+static int parseTransferTable(snd_config_t* conf, TransferTable& ttable)
+{
+    if (snd_config_get_type(conf) != SND_CONFIG_TYPE_COMPOUND)
+        return -EINVAL;
+
+    auto parseChannel = [](snd_config_t* node) -> long
+    {
+        const char* id = nullptr;
+        if (snd_config_get_id(node, &id) < 0)
+            return -EINVAL;
+        char* end = nullptr;
+        long channel = strtol(id, &end, 10);
+        if ((*end != '\0') || (channel < 0) || (channel >= kMaxChannels))
+            return -EINVAL;
+        return channel;
+    };
+
+    snd_config_iterator_t i, next;
+    snd_config_for_each(i, next, conf)
+    {
+        snd_config_t* in = snd_config_iterator_entry(i);
+        long in_channel = parseChannel(in);
+        if ((in_channel < 0) || (snd_config_get_type(in) != SND_CONFIG_TYPE_COMPOUND))
+            return -EINVAL;
+
+        snd_config_iterator_t j, jnext;
+        snd_config_for_each(j, jnext, in)
+        {
+            snd_config_t* out = snd_config_iterator_entry(j);
+            long out_channel = parseChannel(out);
+            double gain = 0;
+            if ((out_channel < 0) || (snd_config_get_ireal(out, &gain) < 0))
+                return -EINVAL;
+            ttable[{static_cast<uint16_t>(in_channel), static_cast<uint16_t>(out_channel)}] = static_cast<float>(gain);
+        }
+    }
+    return 0;
+}
+
+
 extern "C"
 {
     SND_PCM_PLUGIN_DEFINE_FUNC(snapcast)
@@ -492,10 +924,15 @@ extern "C"
         const char* format = nullptr;
         long fd = -1, ifd = -1, trunc = 1;
         long perm = 0600;
-        Uri uri("tcp://127.0.0.1:4953");
-        SampleFormat sampleformat("44100:16:2");
+        Settings settings;
         AixLog::Filter logfilter(AixLog::Severity::info);
         std::string logfile;
+        bool logasync{false};
+        // format and wireformat default to sampleformat, regardless of the order in the configuration
+        std::optional<SampleFormat> client_format;
+        std::optional<SampleFormat> wire_format;
+        // the kernels are shared by all devices of the process, nullopt keeps the current selection
+        std::optional<SimdLevel> simd_level;
 
         snd_config_for_each(i, next, conf)
         {
@@ -509,9 +946,9 @@ extern "C"
                 const char* uri_param = nullptr;
                 err = snd_config_get_string(n, &uri_param);
                 // TODO: error handling
-                uri = Uri(uri_param);
-                if (!uri.port.has_value())
-                    uri.port = 4953;
+                settings.uri = Uri(uri_param);
+                if (!settings.uri.port.has_value())
+                    settings.uri.port = 4953;
 
                 if (err < 0)
                 {
@@ -522,13 +959,224 @@ extern "C"
             if (strcmp(id, "sampleformat") == 0)
             {
                 const char* sample_param = nullptr;
-                err = snd_config_get_string(n, &sample_param);
-                // TODO: error handling
-                sampleformat = SampleFormat(sample_param);
+                if (snd_config_get_string(n, &sample_param) < 0)
+                {
+                    SNDERR("Invalid sampleformat");
+                    return -EINVAL;
+                }
+                try
+                {
+                    settings.sampleformat = SampleFormat(sample_param);
+                }
+                catch (const std::exception& e)
+                {
+                    SNDERR("Invalid sampleformat '%s': %s", sample_param, e.what());
+                    return -EINVAL;
+                }
+                continue;
+            }
+
+            if ((strcmp(id, "format") == 0) || (strcmp(id, "wireformat") == 0))
+            {
+                const char* param = nullptr;
+                if (snd_config_get_string(n, &param) < 0)
+                {
+                    SNDERR("Invalid %s", id);
+                    return -EINVAL;
+                }
+                try
+                {
+                    (strcmp(id, "format") == 0 ? client_format : wire_format) = SampleFormat(param);
+                }
+                catch (const std::exception& e)
+                {
+                    SNDERR("Invalid %s '%s': %s", id, param, e.what());
+                    return -EINVAL;
+                }
+                continue;
+            }
+
+            if (strcmp(id, "protocol") == 0)
+            {
+                const char* param = nullptr;
+                if (snd_config_get_string(n, &param) < 0)
+                {
+                    SNDERR("Invalid protocol");
+                    return -EINVAL;
+                }
+                if (strcmp(param, "raw") == 0)
+                    settings.protocol = Protocol::raw;
+                else if (strcmp(param, "snapstream") == 0)
+                    settings.protocol = Protocol::snapstream;
+                else
+                {
+                    SNDERR("Invalid protocol '%s', must be 'raw' or 'snapstream'", param);
+                    return -EINVAL;
+                }
+                continue;
+            }
+
+            if (strcmp(id, "chmap") == 0)
+            {
+                const char* param = nullptr;
+                snd_pcm_chmap_t* map = nullptr;
+                if ((snd_config_get_string(n, &param) < 0) || !(map = snd_pcm_chmap_parse_string(param)))
+                {
+                    SNDERR("Invalid chmap");
+                    return -EINVAL;
+                }
+                settings.chmap.clear();
+                for (unsigned int c = 0; c < map->channels; ++c)
+                {
+                    auto position = map->pos[c] & SND_CHMAP_POSITION_MASK;
+                    if (position > static_cast<unsigned int>(ChannelPosition::tc))
+                        position = static_cast<unsigned int>(ChannelPosition::unknown);
+                    settings.chmap.push_back(static_cast<ChannelPosition>(position));
+                }
+                free(map);
+                continue;
+            }
+
+            if (strcmp(id, "ttable") == 0)
+            {
+                err = parseTransferTable(n, settings.ttable);
+                if (err < 0)
+                {
+                    SNDERR("Invalid ttable");
+                    return err;
+                }
+                continue;
+            }
+
+            if (strcmp(id, "drain_timeout") == 0)
+            {
+                long param = 0;
+                if ((snd_config_get_integer(n, &param) < 0) || (param < 0))
+                {
+                    SNDERR("Invalid drain_timeout");
+                    return -EINVAL;
+                }
+                settings.drain_timeout = std::chrono::milliseconds(param);
+                continue;
+            }
+
+            if ((strcmp(id, "jitter_min") == 0) || (strcmp(id, "jitter_max") == 0))
+            {
+                long param = 0;
+                if ((snd_config_get_integer(n, &param) < 0) || (param < 0))
+                {
+                    SNDERR("Invalid %s", id);
+                    return -EINVAL;
+                }
+                (strcmp(id, "jitter_min") == 0 ? settings.jitter_min : settings.jitter_max) =
+                    std::chrono::milliseconds(param);
+                continue;
+            }
+
+            if (strcmp(id, "volume") == 0)
+            {
+                long param = 0;
+                if ((snd_config_get_integer(n, &param) < 0) || (param < 0) || (param > 100))
+                {
+                    SNDERR("Invalid volume, must be 0-100");
+                    return -EINVAL;
+                }
+                settings.volume = static_cast<uint16_t>(param);
+                continue;
+            }
+
+            if (strcmp(id, "dither") == 0)
+            {
+                err = snd_config_get_bool(n);
+                if (err < 0)
+                {
+                    SNDERR("Invalid dither");
+                    return -EINVAL;
+                }
+                settings.dither = (err != 0);
+                continue;
+            }
+
+            if (strcmp(id, "noiseshaping") == 0)
+            {
+                err = snd_config_get_bool(n);
+                if (err < 0)
+                {
+                    SNDERR("Invalid noiseshaping");
+                    return -EINVAL;
+                }
+                settings.noiseshaping = (err != 0);
+                continue;
+            }
+
+            if (strcmp(id, "rtprio") == 0)
+            {
+                long param = 0;
+                if ((snd_config_get_integer(n, &param) < 0) || (param < 1) || (param > 99))
+                {
+                    SNDERR("Invalid rtprio, must be 1-99");
+                    return -EINVAL;
+                }
+                settings.thread.rtprio = static_cast<int>(param);
+                continue;
+            }
+
+            if (strcmp(id, "nice") == 0)
+            {
+                long param = 0;
+                if ((snd_config_get_integer(n, &param) < 0) || (param < -20) || (param > 19))
+                {
+                    SNDERR("Invalid nice, must be -20-19");
+                    return -EINVAL;
+                }
+                settings.thread.nice = static_cast<int>(param);
+                continue;
+            }
+
+            if (strcmp(id, "cpu_affinity") == 0)
+            {
+                const char* param = nullptr;
+                if ((snd_config_get_string(n, &param) < 0) || !settings.thread.parseCpuList(param))
+                {
+                    SNDERR("Invalid cpu_affinity, must be a CPU list like \"0,2-3\"");
+                    return -EINVAL;
+                }
+                continue;
+            }
+
+            if (strcmp(id, "pool_grace") == 0)
+            {
+                long param = 0;
+                if ((snd_config_get_integer(n, &param) < 0) || (param < 0))
+                {
+                    SNDERR("Invalid pool_grace");
+                    return -EINVAL;
+                }
+                settings.pool_grace = std::chrono::milliseconds(param);
+                continue;
+            }
+
+            if (strcmp(id, "mlock") == 0)
+            {
+                err = snd_config_get_bool(n);
+                if (err < 0)
+                {
+                    SNDERR("Invalid mlock");
+                    return -EINVAL;
+                }
+                settings.mlock = (err != 0);
+                continue;
+            }
 
+            if (strcmp(id, "pool_silence") == 0)
+            {
+                err = snd_config_get_bool(n);
                 if (err < 0)
                 {
+                    SNDERR("Invalid pool_silence");
+                    return -EINVAL;
                 }
+                settings.pool_silence = (err != 0);
                 continue;
             }
 
@@ -543,6 +1191,97 @@ extern "C"
                 continue;
             }
 
+            if (strcmp(id, "statsfile") == 0)
+            {
+                const char* param = nullptr;
+                err = snd_config_get_string(n, &param);
+                if (err < 0)
+                {
+                    SNDERR("Invalid statsfile");
+                    return -EINVAL;
+                }
+                settings.statsfile = param;
+                continue;
+            }
+
+            if (strcmp(id, "stats_interval") == 0)
+            {
+                long param = 0;
+                if ((snd_config_get_integer(n, &param) < 0) || (param <= 0))
+                {
+                    SNDERR("Invalid stats_interval");
+                    return -EINVAL;
+                }
+                settings.stats_interval = std::chrono::milliseconds(param);
+                continue;
+            }
+
+            if (strcmp(id, "pacing") == 0)
+            {
+                const char* param = nullptr;
+                if (snd_config_get_string(n, &param) < 0)
+                {
+                    SNDERR("Invalid pacing");
+                    return -EINVAL;
+                }
+                if (strcmp(param, "none") == 0)
+                    settings.pacing = Pacing::none;
+                else if (strcmp(param, "realtime") == 0)
+                    settings.pacing = Pacing::realtime;
+                else if (strcmp(param, "server") == 0)
+                    settings.pacing = Pacing::server;
+                else
+                {
+                    SNDERR("Invalid pacing '%s', must be 'none', 'realtime' or 'server'", param);
+                    return -EINVAL;
+                }
+                continue;
+            }
+
+            if (strcmp(id, "packing") == 0)
+            {
+                err = snd_config_get_bool(n);
+                if (err < 0)
+                {
+                    SNDERR("Invalid packing");
+                    return -EINVAL;
+                }
+                settings.packing = (err != 0);
+                continue;
+            }
+
+            if (strcmp(id, "simd") == 0)
+            {
+                const char* param = nullptr;
+                if (snd_config_get_string(n, &param) < 0)
+                {
+                    SNDERR("Invalid simd");
+                    return -EINVAL;
+                }
+                if (strcmp(param, "auto") == 0)
+                    simd_level = simd::detect();
+                else if (auto level = simd::parse(param); level.has_value())
+                    simd_level = level;
+                else
+                {
+                    SNDERR("Invalid simd '%s', must be 'auto', 'generic', 'avx2' or 'avx512'", param);
+                    return -EINVAL;
+                }
+                continue;
+            }
+
+            if (strcmp(id, "logasync") == 0)
+            {
+                err = snd_config_get_bool(n);
+                if (err < 0)
+                {
+                    SNDERR("Invalid logasync");
+                    return -EINVAL;
+                }
+                logasync = (err != 0);
+                continue;
+            }
+
             if (strcmp(id, "logfile") == 0)
             {
                 const char* param = nullptr;
@@ -552,16 +1291,52 @@ extern "C"
             }
         }
 
+        settings.format = client_format.value_or(settings.sampleformat);
+        if (wire_format.has_value())
+            settings.sampleformat = *wire_format;
+        if (settings.format.rate() != settings.sampleformat.rate())
+        {
+            SNDERR("format and wireformat must have the same rate");
+            return -EINVAL;
+        }
+        if ((settings.jitter_max.count() <= 0) || (settings.jitter_max < settings.jitter_min))
+        {
+            SNDERR("jitter_max must be positive and not less than jitter_min");
+            return -EINVAL;
+        }
+
+        if (settings.chmap.empty())
+        {
+            settings.chmap = ChannelMixer::defaultLayout(settings.sampleformat.channels());
+        }
+        else if (settings.chmap.size() != settings.sampleformat.channels())
+        {
+            SNDERR("chmap doesn't match the number of channels in sampleformat");
+            return -EINVAL;
+        }
+
+        AixLog::log_sink_ptr logsink;
         if (!logfile.empty())
-            AixLog::Log::init<AixLog::SinkFile>(logfilter, logfile);
+            logsink = std::make_shared<AixLog::SinkFile>(logfilter, logfile);
         else
-            AixLog::Log::init<AixLog::SinkNative>("snapstream", logfilter);
+            logsink = std::make_shared<AixLog::SinkNative>("snapstream", logfilter);
+        // File and syslog I/O happens on a background thread, so that logging doesn't block the audio callbacks
+        if (logasync)
+            logsink = std::make_shared<AixLog::SinkAsync>(logfilter, logsink);
+        AixLog::Log::init({logsink});
+
+        if (simd_level.has_value() && (simd::force(*simd_level) != *simd_level))
+            LOG(WARNING, LOG_TAG) << "The CPU doesn't support simd level " << simd::toString(*simd_level)
+                                  << ", using " << simd::toString(simd::active()) << "\n";
+
+        // Resolve the server while the client is still configuring the device
+        ResolverCache::instance().prefetch(settings.uri.host, settings.uri.port.value_or(4953));
 
         SnapcastPcm* plugin{new (std::nothrow) SnapcastPcm{}};
         if (!plugin)
             return -ENOMEM;
 
-        err = plugin->Initialize(name ? name : "Snapcast PCM", stream, mode, sampleformat, uri);
+        err = plugin->Initialize(name ? name : "Snapcast PCM", stream, mode, settings);
         if (err < 0)
         {
             delete plugin;
@@ -0,0 +1,103 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// standard headers
+#include <cstdint>
+
+
+/// Wire protocol of a stream
+enum class Protocol
+{
+    /// raw PCM, as expected by the TCP stream source. Only the server's control messages are framed.
+    raw,
+    /// audio and control messages are framed in both directions
+    snapstream
+};
+
+
+/// Messages of the snapstream protocol
+/// With the raw protocol, only the control messages sent by the server on the otherwise unused back channel of a
+/// playback stream are framed. Every message starts with a Header, followed by Header::size bytes of payload.
+/// All fields are little endian.
+namespace msg
+{
+
+/// Message types
+enum class Type : uint16_t
+{
+    /// payload: Volume
+    volume = 1,
+    /// payload: PCM in the stream's sample format
+    audio = 2,
+    /// end of stream, the client has drained. No payload
+    eos = 3,
+    /// the client has paused, the receiver should hold its buffered audio. No payload
+    pause = 4,
+    /// the client has resumed after a pause. No payload
+    resume = 5,
+    /// sent periodically while paused. No payload
+    keepalive = 6,
+    /// the client has dropped its queued audio, the receiver should drop its buffered audio too. No payload
+    flush = 7,
+    /// payload: Position, sent before the first audio message and whenever the client's timeline is interrupted
+    position = 8,
+};
+
+/// Message header
+struct Header
+{
+    /// message type, see Type
+    uint16_t type;
+    /// Type::audio: how the payload is packed, see kFlagMono and kFlagWidth16. Else reserved, must be 0
+    uint16_t flags;
+    /// size of the payload in bytes
+    uint32_t size;
+};
+static_assert(sizeof(Header) == 8);
+
+/// Largest accepted payload, larger messages are considered a protocol error
+constexpr uint32_t kMaxPayload = 64 * 1024;
+
+/// Audio flag: all channels were identical, only the first channel is sent
+constexpr uint16_t kFlagMono = 1;
+/// Audio flag: 24 and 32 bit samples whose lower bits were zero are sent as their upper 16 significant bits
+constexpr uint16_t kFlagWidth16 = 2;
+
+/// Payload of a Type::volume message
+struct Volume
+{
+    /// volume in percent [0..100]
+    uint16_t percent;
+    /// 0 = not muted, else muted
+    uint16_t muted;
+};
+static_assert(sizeof(Volume) == 4);
+
+/// Payload of a Type::position message
+/// The position of the following audio frames is counted on from here, until the next Position.
+struct Position
+{
+    /// index of the next audio frame in the client's timeline, counted from opening the device. Audio that was dropped
+    /// by a flush is included, i.e. the difference to the received frames is the dropped audio.
+    uint64_t frame;
+};
+static_assert(sizeof(Position) == 8);
+
+} // namespace msg
@@ -0,0 +1,150 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "resolver_cache.hpp"
+
+// local headers
+#include "aixlog.hpp"
+
+
+static constexpr auto LOG_TAG = "ResolverCache";
+
+/// Time after which a resolved host is refreshed
+static constexpr auto kTtl = std::chrono::minutes(5);
+/// Minimum time between two resolves of a host, if connecting fails or the DNS server doesn't answer
+static constexpr auto kRetry = std::chrono::seconds(30);
+
+using namespace std::chrono;
+
+
+namespace
+{
+std::string keyOf(const std::string& host, uint16_t port)
+{
+    return host + ":" + std::to_string(port);
+}
+} // namespace
+
+
+ResolverCache& ResolverCache::instance()
+{
+    static ResolverCache cache;
+    return cache;
+}
+
+
+ResolverCache::ResolverCache()
+    : work_(boost::asio::prefer(io_context_.get_executor(), boost::asio::execution::outstanding_work.tracked)),
+      resolver_(io_context_)
+{
+    thread_ = std::thread([this]() { io_context_.run(); });
+}
+
+
+ResolverCache::~ResolverCache()
+{
+    // The resolver must only be used from the io_context's thread
+    boost::asio::post(io_context_, [this]()
+    {
+        resolver_.cancel();
+        io_context_.stop();
+    });
+    thread_.join();
+}
+
+
+void ResolverCache::prefetch(const std::string& host, uint16_t port)
+{
+    std::scoped_lock lock(mutex_);
+    auto& entry = entries_[keyOf(host, port)];
+    if (entry.endpoints.empty() && !entry.refreshing)
+        refresh(entry, host, port);
+}
+
+
+std::vector<tcp::endpoint> ResolverCache::lookup(const std::string& host, uint16_t port)
+{
+    std::scoped_lock lock(mutex_);
+    auto iter = entries_.find(keyOf(host, port));
+    if (iter == entries_.end())
+        return {};
+
+    auto& entry = iter->second;
+    // serve stale while refreshing
+    if (!entry.endpoints.empty() && (steady_clock::now() > entry.expiry) && !entry.refreshing)
+        refresh(entry, host, port);
+    return entry.endpoints;
+}
+
+
+void ResolverCache::store(const std::string& host, uint16_t port, std::vector<tcp::endpoint> endpoints)
+{
+    if (endpoints.empty())
+        return;
+    std::scoped_lock lock(mutex_);
+    auto& entry = entries_[keyOf(host, port)];
+    entry.endpoints = std::move(endpoints);
+    entry.resolved = steady_clock::now();
+    entry.expiry = entry.resolved + kTtl;
+}
+
+
+void ResolverCache::invalidate(const std::string& host, uint16_t port)
+{
+    std::scoped_lock lock(mutex_);
+    auto& entry = entries_[keyOf(host, port)];
+    auto now = steady_clock::now();
+    if (entry.refreshing || (now - entry.resolved < kRetry))
+        return;
+    entry.expiry = now;
+    refresh(entry, host, port);
+}
+
+
+void ResolverCache::refresh(Entry& entry, const std::string& host, uint16_t port)
+{
+    LOG(DEBUG, LOG_TAG) << "Refresh " << keyOf(host, port) << "\n";
+    entry.refreshing = true;
+    entry.resolved = steady_clock::now();
+    // The resolver must only be used from the io_context's thread
+    boost::asio::post(io_context_, [this, host, port]()
+    {
+        resolver_.async_resolve(
+            host, std::to_string(port),
+            [this, host, port](const boost::system::error_code& ec, const tcp::resolver::results_type& results)
+        {
+            std::scoped_lock lock(mutex_);
+            auto& entry = entries_[keyOf(host, port)];
+            entry.refreshing = false;
+            if (ec)
+            {
+                // keep serving the stale endpoints, if any, until the next attempt
+                LOG(WARNING, LOG_TAG) << "Failed to resolve '" << host << "': " << ec.message() << "\n";
+                entry.expiry = steady_clock::now() + kRetry;
+                return;
+            }
+            entry.endpoints.clear();
+            for (const auto& result : results)
+                entry.endpoints.push_back(result.endpoint());
+            entry.resolved = steady_clock::now();
+            entry.expiry = entry.resolved + kTtl;
+            LOG(DEBUG, LOG_TAG) << "Resolved " << keyOf(host, port) << ", " << entry.endpoints.size() << " endpoints\n";
+        });
+    });
+}
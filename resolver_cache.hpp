@@ -0,0 +1,84 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// 3rd party headers
+#include <boost/asio.hpp>
+
+// standard headers
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using boost::asio::ip::tcp;
+
+/// Process wide cache of resolved host names, shared by all plugin instances
+///
+/// Expired entries are still served while they are refreshed in the background, so that connecting never waits for
+/// a (slow or absent) DNS server once a host has been resolved.
+class ResolverCache
+{
+public:
+    /// @return the process wide cache
+    static ResolverCache& instance();
+
+    ~ResolverCache();
+
+    /// Resolve @p host in the background, if it is not cached yet
+    void prefetch(const std::string& host, uint16_t port);
+
+    /// @return the cached endpoints of @p host, empty if not cached. Expired entries are refreshed in the background.
+    std::vector<tcp::endpoint> lookup(const std::string& host, uint16_t port);
+
+    /// Store @p endpoints that have been resolved for @p host
+    void store(const std::string& host, uint16_t port, std::vector<tcp::endpoint> endpoints);
+
+    /// Refresh @p host in the background, e.g. because connecting to all cached endpoints failed
+    /// The refreshes are rate limited, so that a server that is down doesn't cause a DNS query per reconnect.
+    void invalidate(const std::string& host, uint16_t port);
+
+private:
+    ResolverCache();
+
+    struct Entry
+    {
+        std::vector<tcp::endpoint> endpoints;
+        std::chrono::steady_clock::time_point expiry;
+        /// time of the last resolve, for the rate limit of invalidate()
+        std::chrono::steady_clock::time_point resolved;
+        bool refreshing = false;
+    };
+
+    /// Start resolving @p host in the background, mutex_ must be locked
+    void refresh(Entry& entry, const std::string& host, uint16_t port);
+
+    boost::asio::io_context io_context_;
+    /// keeps io_context_ running while idle
+    boost::asio::any_io_executor work_;
+    tcp::resolver resolver_;
+    std::thread thread_;
+    std::mutex mutex_;
+    /// host:port => entry
+    std::map<std::string, Entry> entries_;
+};
@@ -50,10 +50,23 @@ SampleFormat::SampleFormat(uint32_t sampleRate, uint16_t bitsPerSample, uint16_t
 }
 
 
+SampleFormat::SampleFormat(uint32_t sampleRate, SampleEncoding encoding, uint16_t channels)
+{
+    setFormat(sampleRate, encoding, channels);
+}
+
+
 string SampleFormat::toString() const
 {
     stringstream ss;
-    ss << rate_ << ":" << bits_ << ":" << channels_;
+    ss << rate_ << ":";
+    if (encoding_ == SampleEncoding::s24_3le)
+        ss << "24_3";
+    else if (encoding_ == SampleEncoding::f32le)
+        ss << "float";
+    else
+        ss << bits_;
+    ss << ":" << channels_;
     return ss.str();
 }
 
@@ -62,25 +75,58 @@ void SampleFormat::setFormat(const std::string& format)
 {
     std::vector<std::string> strs;
     strs = utils::string::split(format, ':');
-    if (strs.size() == 3)
-        setFormat(strs[0] == "*" ? 0 : std::stoul(strs[0]), strs[1] == "*" ? 0 : static_cast<uint16_t>(std::stoul(strs[1])),
-                  strs[2] == "*" ? 0 : static_cast<uint16_t>(std::stoul(strs[2])));
-    else
+    if (strs.size() != 3)
         throw std::invalid_argument("sampleformat must be <rate>:<bits>:<channels>");
+
+    uint32_t rate = strs[0] == "*" ? 0 : std::stoul(strs[0]);
+    auto channels = strs[2] == "*" ? 0 : static_cast<uint16_t>(std::stoul(strs[2]));
+    if (strs[1] == "24_3")
+        setFormat(rate, SampleEncoding::s24_3le, channels);
+    else if (strs[1] == "24_4")
+        setFormat(rate, SampleEncoding::s24_4le, channels);
+    else if (strs[1] == "float")
+        setFormat(rate, SampleEncoding::f32le, channels);
+    else
+        setFormat(rate, strs[1] == "*" ? 0 : static_cast<uint16_t>(std::stoul(strs[1])), channels);
 }
 
 
 void SampleFormat::setFormat(uint32_t rate, uint16_t bits, uint16_t channels)
 {
-    // needs something like:
-    // 24_4 = 3 bytes, padded to 4
-    // 32 = 4 bytes
+    switch (bits)
+    {
+        case 0:
+            // Unspecified, e.g. "*"
+            setFormat(rate, SampleEncoding::s16le, channels);
+            bits_ = 0;
+            sample_size_ = 0;
+            frame_size_ = 0;
+            break;
+        case 8:
+            setFormat(rate, SampleEncoding::s8, channels);
+            break;
+        case 16:
+            setFormat(rate, SampleEncoding::s16le, channels);
+            break;
+        case 24:
+            setFormat(rate, SampleEncoding::s24_4le, channels);
+            break;
+        case 32:
+            setFormat(rate, SampleEncoding::s32le, channels);
+            break;
+        default:
+            throw std::invalid_argument("unsupported bits: " + std::to_string(bits));
+    }
+}
+
+
+void SampleFormat::setFormat(uint32_t rate, SampleEncoding encoding, uint16_t channels)
+{
     rate_ = rate;
-    bits_ = bits;
+    encoding_ = encoding;
+    bits_ = ::sampleBits(encoding);
     channels_ = channels;
-    sample_size_ = bits / 8;
-    if (bits_ == 24)
-        sample_size_ = 4;
+    sample_size_ = ::sampleSize(encoding);
     frame_size_ = channels_ * sample_size_;
     //	LOG(DEBUG) << "SampleFormat: " << rate << ":" << bits << ":" << channels << "\n";
 }
@@ -19,10 +19,127 @@
 #pragma once
 
 // standard headers
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
 
+/// How a sample is stored, all encodings are little endian
+enum class SampleEncoding : uint8_t
+{
+    /// signed 8 bit
+    s8,
+    /// signed 16 bit
+    s16le,
+    /// signed 24 bit in 3 bytes
+    s24_3le,
+    /// signed 24 bit in the lower 3 bytes of 4 bytes
+    s24_4le,
+    /// signed 32 bit
+    s32le,
+    /// 32 bit float, full scale is [-1, 1]
+    f32le
+};
+
+/// Number of SampleEncodings, for dispatch tables
+constexpr size_t kSampleEncodings = 6;
+
+
+/// A 24 bit sample in 3 bytes, so that pointer arithmetic works on packed samples
+struct Packed24
+{
+    uint8_t bytes[3];
+};
+
+
+/// Compile time properties of a SampleEncoding
+/// type: the type of a sample in memory, bits: significant bits, is_float: floating point samples
+template <SampleEncoding E>
+struct EncodingTraits;
+
+template <>
+struct EncodingTraits<SampleEncoding::s8>
+{
+    using type = int8_t;
+    static constexpr uint16_t bits = 8;
+    static constexpr bool is_float = false;
+};
+
+template <>
+struct EncodingTraits<SampleEncoding::s16le>
+{
+    using type = int16_t;
+    static constexpr uint16_t bits = 16;
+    static constexpr bool is_float = false;
+};
+
+template <>
+struct EncodingTraits<SampleEncoding::s24_3le>
+{
+    using type = Packed24;
+    static constexpr uint16_t bits = 24;
+    static constexpr bool is_float = false;
+};
+
+template <>
+struct EncodingTraits<SampleEncoding::s24_4le>
+{
+    using type = int32_t;
+    static constexpr uint16_t bits = 24;
+    static constexpr bool is_float = false;
+};
+
+template <>
+struct EncodingTraits<SampleEncoding::s32le>
+{
+    using type = int32_t;
+    static constexpr uint16_t bits = 32;
+    static constexpr bool is_float = false;
+};
+
+template <>
+struct EncodingTraits<SampleEncoding::f32le>
+{
+    using type = float;
+    static constexpr uint16_t bits = 32;
+    static constexpr bool is_float = true;
+};
+
+
+/// @return size in bytes of a sample with @p encoding
+constexpr uint16_t sampleSize(SampleEncoding encoding)
+{
+    switch (encoding)
+    {
+        case SampleEncoding::s8:
+            return 1;
+        case SampleEncoding::s16le:
+            return 2;
+        case SampleEncoding::s24_3le:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+/// @return significant bits of a sample with @p encoding
+constexpr uint16_t sampleBits(SampleEncoding encoding)
+{
+    switch (encoding)
+    {
+        case SampleEncoding::s8:
+            return 8;
+        case SampleEncoding::s16le:
+            return 16;
+        case SampleEncoding::s24_3le:
+        case SampleEncoding::s24_4le:
+            return 24;
+        default:
+            return 32;
+    }
+}
+
+
 /**
  * sample and frame as defined in alsa:
  * http://www.alsa-project.org/main/index.php/FramesPeriods
@@ -34,6 +151,9 @@
  * To sustain 2x 44.1 KHz analog rate - the system must be capable of data transfer rate, in Bytes/sec:
  * Bps_rate = (num_channels) * (1 sample in bytes) * (analog_rate) = (1 frame) * (analog_rate) = ( 2 channels ) * (2 bytes/sample) * (44100 samples/sec) =
  * 2*2*44100 = 176400 Bytes/sec (link to formula img)
+ *
+ * The bits of the string representation are 8, 16, 24 (in 4 bytes), 32, or 24_3 (in 3 bytes), float (32 bit float),
+ * 24_4 is accepted as well.
  */
 class SampleFormat
 {
@@ -44,14 +164,18 @@ public:
     SampleFormat(const std::string& format);
     /// c'tor
     SampleFormat(uint32_t rate, uint16_t bits, uint16_t channels);
+    /// c'tor
+    SampleFormat(uint32_t rate, SampleEncoding encoding, uint16_t channels);
 
     /// @return sampleformat as string rate:bits::channels
     std::string toString() const;
 
     /// Set @p format (rate:bits::channels)
     void setFormat(const std::string& format);
-    /// Set format
+    /// Set format, 24 @p bits are padded to 4 bytes
     void setFormat(uint32_t rate, uint16_t bits, uint16_t channels);
+    /// Set format
+    void setFormat(uint32_t rate, SampleEncoding encoding, uint16_t channels);
 
     /// @return if has format
     bool isInitialized() const
@@ -77,6 +201,12 @@ public:
         return channels_;
     }
 
+    /// @return how the samples are stored
+    SampleEncoding encoding() const
+    {
+        return encoding_;
+    }
+
     /// @return size in [bytes] of a single mono sample, e.g. 2 bytes (= 16 bits)
     uint16_t sampleSize() const
     {
@@ -108,6 +238,7 @@ public:
     }
 
 private:
+    SampleEncoding encoding_;
     uint16_t sample_size_;
     uint16_t frame_size_;
     uint32_t rate_;
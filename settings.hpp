@@ -0,0 +1,90 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// local headers
+#include "channel_mixer.hpp"
+#include "protocol.hpp"
+#include "sample_format.hpp"
+#include "thread_settings.hpp"
+#include "uri.hpp"
+
+// standard headers
+#include <chrono>
+#include <optional>
+#include <string>
+
+
+/// How a playback device paces its client
+enum class Pacing
+{
+    /// don't wait, the client writes as fast as the socket accepts the audio, e.g. for offline rendering
+    none,
+    /// wait for the duration of each period, like a sound card
+    realtime,
+    /// don't wait, the server's reading sets the rate: at most one period is queued, with a small socket buffer
+    server
+};
+
+
+/// Settings of a Snapcast PCM device, as configured in the ALSA configuration
+struct Settings
+{
+    /// the url of the TCP server where the audio is sent to
+    Uri uri{"tcp://127.0.0.1:4953"};
+    /// the sample format that is sent to the server
+    SampleFormat sampleformat{"44100:16:2"};
+    /// the sample format accepted from (playback) or delivered to (capture) the client, converted from or into
+    /// sampleformat. Its rate is the same, playback accepts any number of channels.
+    SampleFormat format{"44100:16:2"};
+    /// raw PCM or the framed snapstream protocol
+    Protocol protocol{Protocol::raw};
+    /// the channel layout that is sent to the server, defaults to the ALSA layout for the number of channels
+    ChannelLayout chmap;
+    /// optional route plugin style transfer table to mix the client's channels into the server's channels
+    TransferTable ttable;
+    /// scheduling of the streaming thread
+    ThreadSettings thread;
+    /// lock the audio buffers into RAM
+    bool mlock{false};
+    /// capture: minimum depth of the jitter buffer
+    std::chrono::milliseconds jitter_min{20};
+    /// capture: maximum depth of the jitter buffer
+    std::chrono::milliseconds jitter_max{500};
+    /// playback: initial volume in percent, until the server or a mixer sets the volume
+    std::optional<uint16_t> volume;
+    /// dither when requantizing to 16 bits or less
+    bool dither{true};
+    /// shape the dither's noise towards high frequencies
+    bool noiseshaping{false};
+    /// playback: maximum time to wait for queued audio to be sent on drain
+    std::chrono::milliseconds drain_timeout{2000};
+    /// playback: time to keep the connection open after close, for the next open. 0 to disable
+    std::chrono::milliseconds pool_grace{0};
+    /// playback: send silence while the connection is kept open without a client
+    bool pool_silence{false};
+    /// playback: how Transfer paces the client
+    Pacing pacing{Pacing::realtime};
+    /// playback: pack audio messages losslessly, if all channels are identical or the samples are padded 16 bit
+    bool packing{false};
+    /// file that is periodically rewritten with the stream's counters, disabled if empty
+    std::string statsfile;
+    /// time between two updates of statsfile
+    std::chrono::milliseconds stats_interval{1000};
+};
@@ -0,0 +1,99 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "simd.hpp"
+
+// standard headers
+#include <algorithm>
+#include <atomic>
+#include <initializer_list>
+
+
+namespace simd
+{
+
+namespace
+{
+/// the level that kernels are selected for
+std::atomic<SimdLevel>& current()
+{
+    static std::atomic<SimdLevel> level{detect()};
+    return level;
+}
+} // namespace
+
+
+SimdLevel detect()
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return SimdLevel::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::avx2;
+#endif
+    return SimdLevel::generic;
+}
+
+
+SimdLevel active()
+{
+    return current().load(std::memory_order_relaxed);
+}
+
+
+SimdLevel force(SimdLevel level)
+{
+    level = std::min(level, detect());
+    current().store(level, std::memory_order_relaxed);
+    return level;
+}
+
+
+void reset()
+{
+    current().store(detect(), std::memory_order_relaxed);
+}
+
+
+std::string toString(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::avx2:
+            return "avx2";
+        case SimdLevel::avx512:
+            return "avx512";
+        default:
+            return "generic";
+    }
+}
+
+
+std::optional<SimdLevel> parse(const std::string& name)
+{
+    for (auto level : {SimdLevel::generic, SimdLevel::avx2, SimdLevel::avx512})
+    {
+        if (name == toString(level))
+            return level;
+    }
+    return std::nullopt;
+}
+
+} // namespace simd
@@ -0,0 +1,80 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// standard headers
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+
+/// Instruction sets that the audio kernels are compiled for
+enum class SimdLevel : uint8_t
+{
+    /// the compiler's baseline, e.g. SSE2 on x86-64 or NEON on aarch64
+    generic,
+    /// x86 AVX2
+    avx2,
+    /// x86 AVX-512 F and BW
+    avx512
+};
+
+/// Number of SimdLevels, for dispatch tables
+constexpr size_t kSimdLevels = 3;
+
+/// Kernels are compiled for each SimdLevel by wrapping an always inlined implementation into a function with the
+/// level's target attribute, so that the compiler vectorizes the inlined loops for that level.
+/// Only on x86-64, whose baseline includes SSE2. 32 bit x86 builds use the generic kernels.
+#if defined(__x86_64__)
+/// the CPU is checked at runtime for the levels beyond generic
+constexpr bool kSimdDispatch = true;
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#else
+constexpr bool kSimdDispatch = false;
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#endif
+#define SIMD_INLINE inline __attribute__((always_inline))
+
+
+namespace simd
+{
+
+/// @return the best level that the CPU supports
+SimdLevel detect();
+
+/// @return the level that kernels are selected for: detect(), unless forced
+SimdLevel active();
+
+/// Select kernels for @p level, for the whole process. Levels that the CPU doesn't support are limited to detect()
+/// @return the active level
+SimdLevel force(SimdLevel level);
+
+/// Select kernels for detect() again
+void reset();
+
+/// @return name of @p level
+std::string toString(SimdLevel level);
+
+/// @return the level with @p name, or nullopt if there is none
+std::optional<SimdLevel> parse(const std::string& name);
+
+} // namespace simd
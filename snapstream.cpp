@@ -21,34 +21,138 @@
 
 // local headers
 #include "aixlog.hpp"
+#include "audio_packing.hpp"
+#include "resolver_cache.hpp"
 
 // 3rd party headers
 #include <boost/asio.hpp>
 
 // standard headers
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <thread>
 
 
 static constexpr auto LOG_TAG = "SnapStream";
 
+/// Interval of keepalive messages while paused
+static constexpr auto kKeepaliveInterval = std::chrono::seconds(1);
+/// Duration of a chunk of silence
+static constexpr auto kSilencePeriod = std::chrono::milliseconds(20);
+
 using boost::asio::ip::tcp;
 using namespace std::chrono_literals;
 
 
-SnapStream::SnapStream(Uri uri)
-    : socket_(io_context_), resolver_(io_context_), timer_(io_context_), uri_(std::move(uri)), connected_(false)
+SnapStream::SnapStream(Uri uri, Protocol protocol)
+    : socket_(io_context_), resolver_(io_context_), timer_(io_context_), keepalive_timer_(io_context_),
+      silence_timer_(io_context_), uri_(std::move(uri)), protocol_(protocol), connected_(false),
+      stats_(std::make_shared<Stats>())
+{
+    LOG(INFO, LOG_TAG) << "Create SnapStream: " << uri_.toString()
+                       << ", protocol: " << (protocol_ == Protocol::raw ? "raw" : "snapstream") << "\n";
+}
+
+
+SnapStream::~SnapStream()
+{
+    for (const auto& [address, size] : locked_)
+        munlock(address, size);
+}
+
+
+void SnapStream::reserve(size_t count, size_t size, bool lock)
+{
+    std::scoped_lock queue_lock(queue_mutex_);
+    // room for the message header
+    size += sizeof(msg::Header);
+    if (messages_.capacity() < count)
+        messages_.set_capacity(count);
+    free_buffers_.reserve(messages_.capacity());
+    while (free_buffers_.size() + messages_.size() < count)
+        free_buffers_.emplace_back();
+
+    for (auto& buffer : free_buffers_)
+    {
+        if (buffer.capacity() >= size)
+            continue;
+        buffer.reserve(size);
+        if (lock)
+        {
+            if (mlock(buffer.data(), buffer.capacity()) == 0)
+                locked_.emplace_back(buffer.data(), buffer.capacity());
+            else
+                LOG(WARNING, LOG_TAG) << "Failed to lock " << buffer.capacity() << " bytes: " << strerror(errno)
+                                      << ", RLIMIT_MEMLOCK might be too low\n";
+        }
+    }
+    LOG(DEBUG, LOG_TAG) << "Reserved " << count << " buffers of " << size << " bytes\n";
+}
+
+
+std::shared_ptr<Stats> SnapStream::stats() const
+{
+    return stats_;
+}
+
+
+size_t SnapStream::allocations() const
+{
+    return allocations_ + post_memory_.fallbacks() + write_memory_.fallbacks();
+}
+
+
+void SnapStream::setDataHandler(DataHandler handler)
+{
+    data_handler_ = std::move(handler);
+}
+
+
+void SnapStream::setMessageHandler(MessageHandler handler)
+{
+    message_handler_ = std::move(handler);
+}
+
+
+void SnapStream::setThreadSettings(ThreadSettings settings)
+{
+    thread_settings_ = std::move(settings);
+}
+
+
+void SnapStream::setSendBufferSize(int bytes)
+{
+    send_buffer_size_ = bytes;
+}
+
+
+void SnapStream::setPacking(const SampleFormat& format)
 {
-    LOG(INFO, LOG_TAG) << "Create SnapStream: " << uri_.toString() << "\n";
+    packing_ = format;
 }
 
 
 void SnapStream::resolve()
 {
+    if (!running_)
+        return;
     LOG(DEBUG, LOG_TAG) << "Resolve\n";
+    // Reconnects don't wait for the DNS server, the cache is refreshed in the background
+    auto endpoints = ResolverCache::instance().lookup(uri_.host, uri_.port.value());
+    if (!endpoints.empty())
+    {
+        connect(std::move(endpoints));
+        return;
+    }
+
     resolver_.async_resolve(uri_.host, std::to_string(uri_.port.value()),
                             [this](const boost::system::error_code& ec, const tcp::resolver::results_type& results)
     {
+        if (!running_)
+            return;
         if (ec)
         {
             LOG(ERROR, LOG_TAG) << "Failed to resolve host '" << uri_.host << "', error: " << ec
@@ -65,38 +169,73 @@ void SnapStream::resolve()
         }
         else
         {
+            std::vector<tcp::endpoint> endpoints;
             for (const auto& iter : results)
+            {
                 LOG(INFO, LOG_TAG) << "Resolved IP: " << iter.endpoint().address().to_string() << "\n";
+                endpoints.push_back(iter.endpoint());
+            }
+            ResolverCache::instance().store(uri_.host, uri_.port.value(), endpoints);
 
-            connect(results.begin()->endpoint());
+            connect(std::move(endpoints));
         }
     });
 }
 
 
-void SnapStream::connect(const boost::asio::ip::basic_endpoint<tcp>& ep)
+void SnapStream::connect(std::vector<tcp::endpoint> endpoints, size_t index)
 {
+    auto ep = endpoints[index];
     LOG(DEBUG, LOG_TAG) << "Connecting to: " << ep << "\n";
     socket_.async_connect(ep,
-                          [this, ep](boost::system::error_code ec)
+                          [this, ep, endpoints = std::move(endpoints), index](boost::system::error_code ec) mutable
     {
+        if (!running_)
+            return;
         if (!ec)
         {
             LOG(INFO, LOG_TAG) << "Connected to '" << ep << "'\n";
+            // Detect dead connections while paused with the raw protocol
+            boost::system::error_code error;
+            socket_.set_option(boost::asio::socket_base::keep_alive(true), error);
+            if (send_buffer_size_ > 0)
+                socket_.set_option(boost::asio::socket_base::send_buffer_size(send_buffer_size_), error);
             connected_ = true;
+            stats_->connected = true;
+            if (++connects_ > 1)
+                ++stats_->reconnects;
+            if (disconnected_.has_value())
+                stats_->reconnect_us.record(Clock::instance().now() - *disconnected_);
+            disconnected_.reset();
+            rx_buffer_.clear();
+            {
+                // waitForConnection checks connected_ under the lock
+                std::scoped_lock lock(queue_mutex_);
+            }
+            queue_cv_.notify_all();
             read();
         }
         else
         {
             LOG(ERROR, LOG_TAG) << "Failed to connect to '" << ep << "': " << ec << ", message: " << ec.message()
                                 << "\n";
+            if (index + 1 < endpoints.size())
+            {
+                // The next endpoint might be of another protocol family
+                boost::system::error_code error;
+                socket_.close(error);
+                connect(std::move(endpoints), index + 1);
+                return;
+            }
+            // The host might have moved, the cached addresses are used until the refresh succeeds
+            ResolverCache::instance().invalidate(uri_.host, uri_.port.value());
             timer_.expires_after(1s);
             timer_.async_wait(
-                [this, ep](const boost::system::error_code& ec)
+                [this](const boost::system::error_code& ec)
             {
                 if (!ec)
                 {
-                    connect(ep);
+                    resolve();
                 }
             });
         }
@@ -110,9 +249,20 @@ void SnapStream::start()
         return;
     LOG(INFO, LOG_TAG) << "Start\n";
 
-    resolve();
+    // Handlers that were posted after the last stop(), e.g. the send() of a write, are still queued. Run them
+    // before starting, so that they can't interfere with the new connection.
+    io_context_.restart();
+    io_context_.poll();
     io_context_.restart();
-    t_ = std::thread([&]() { io_context_.run(); });
+    running_ = true;
+    clearQueue();
+    resolve();
+    t_ = std::thread(
+        [&]()
+    {
+        thread_settings_.apply("SnapStream");
+        io_context_.run();
+    });
     LOG(INFO, LOG_TAG) << "Started\n";
 }
 
@@ -125,11 +275,22 @@ void SnapStream::stop()
         return;
     }
 
-    socket_.close();
-    timer_.cancel();
-    io_context_.stop();
+    // The socket and the timers must only be used from the io_context's thread. Once their handlers have
+    // completed, without starting new operations, run() returns.
+    boost::asio::post(io_context_, [this]()
+    {
+        running_ = false;
+        boost::system::error_code ec;
+        socket_.close(ec);
+        resolver_.cancel();
+        timer_.cancel();
+        keepalive_timer_.cancel();
+        silence_timer_.cancel();
+    });
     connected_ = false;
+    stats_->connected = false;
     t_.join();
+    clearQueue();
     LOG(INFO, LOG_TAG) << "Stopped\n";
 }
 
@@ -137,45 +298,381 @@ void SnapStream::stop()
 void SnapStream::write(const void* data, uint32_t size)
 {
     LOG(DEBUG, LOG_TAG) << "Write " << size << " bytes\n";
+    if (protocol_ == Protocol::snapstream)
+    {
+        writeMessage(msg::Type::audio, data, size);
+        return;
+    }
+
+    if (!connected_)
+    {
+        LOG(DEBUG, LOG_TAG) << "Not connected\n";
+        stats_->dropped_bytes += size;
+        return;
+    }
+
+    enqueue(nullptr, data, size);
+}
+
+
+void SnapStream::writeMessage(msg::Type type, const void* payload, uint32_t size)
+{
+    if (protocol_ != Protocol::snapstream)
+        return;
+
     if (!connected_)
     {
         LOG(DEBUG, LOG_TAG) << "Not connected\n";
+        if (type == msg::Type::audio)
+            stats_->dropped_bytes += size;
         return;
     }
 
-    boost::asio::async_write(socket_, boost::asio::buffer(data, size),
-                             [this](boost::system::error_code ec, std::size_t length)
+    msg::Header header{static_cast<uint16_t>(type), 0, size};
+    if ((type == msg::Type::audio) && packing_)
+    {
+        header.flags = packing::analyze(payload, size, *packing_);
+        header.size = static_cast<uint32_t>(packing::packedSize(size, *packing_, header.flags));
+        stats_->packed_bytes += size - header.size;
+    }
+    enqueue(&header, payload, size);
+}
+
+
+void SnapStream::enqueue(const msg::Header* header, const void* data, uint32_t size)
+{
+    size_t header_size = (header != nullptr) ? sizeof(*header) : 0;
+    uint32_t payload_size = (header != nullptr) ? header->size : size;
+    std::unique_lock lock(queue_mutex_);
+    // The caller's buffer is reused after return, copy it into a recycled buffer
+    std::vector<char> message;
+    if (!free_buffers_.empty())
+    {
+        message = std::move(free_buffers_.back());
+        free_buffers_.pop_back();
+    }
+    if (message.capacity() < header_size + payload_size)
+        ++allocations_;
+    message.resize(header_size + payload_size);
+    if (header != nullptr)
+        memcpy(message.data(), header, header_size);
+    if ((header != nullptr) && (header->flags != 0))
+        packing::pack(data, size, *packing_, header->flags, message.data() + header_size);
+    else if (size > 0)
+        memcpy(message.data() + header_size, data, size);
+
+    if (messages_.full())
+    {
+        ++allocations_;
+        messages_.set_capacity(std::max<size_t>(4, 2 * messages_.capacity()));
+    }
+    messages_.push_back({std::move(message), Clock::instance().now()});
+    stats_->setQueueDepth(messages_.size());
+    if (sending_)
+        return;
+
+    // The socket must only be used from the io_context's thread
+    sending_ = true;
+    lock.unlock();
+    boost::asio::post(io_context_, makeCustomAllocHandler(post_memory_, [this]() { send(); }));
+}
+
+
+bool SnapStream::drain(std::chrono::milliseconds timeout)
+{
+    if (!t_.joinable())
+        return true;
+
+    // The socket drains in real time
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    writeMessage(msg::Type::eos, nullptr, 0);
+
+    std::unique_lock lock(queue_mutex_);
+    bool drained = queue_cv_.wait_until(lock, deadline, [this]() { return messages_.empty() || !connected_; });
+    // A disconnect empties the queue, but the audio is lost
+    drained = drained && messages_.empty() && connected_;
+    lock.unlock();
+
+    // Let close() wait for the kernel to send its queue, at most until the deadline. SO_LINGER has a resolution of
+    // seconds, less than a second left doesn't linger at all
+    auto remaining = std::chrono::floor<std::chrono::seconds>(deadline - std::chrono::steady_clock::now());
+    if (remaining.count() > 0)
     {
+        boost::asio::post(io_context_, [this, seconds = static_cast<int>(remaining.count())]()
+        {
+            boost::system::error_code ec;
+            socket_.set_option(boost::asio::socket_base::linger(true, seconds), ec);
+        });
+    }
+    return drained;
+}
+
+
+bool SnapStream::waitForConnection(std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(queue_mutex_);
+    return queue_cv_.wait_for(lock, timeout, [this]() { return connected_.load(); });
+}
+
+
+bool SnapStream::waitForQueue(size_t messages, std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(queue_mutex_);
+    queue_cv_.wait_for(lock, timeout, [this, messages]() { return (messages_.size() <= messages) || !connected_; });
+    return messages_.size() <= messages;
+}
+
+
+void SnapStream::flush()
+{
+    LOG(INFO, LOG_TAG) << "Flush\n";
+    {
+        std::scoped_lock lock(queue_mutex_);
+        // The first message is being written, a message that is only scheduled is dropped
+        size_t keep = front_written_ ? 1 : 0;
+        size_t dropped = 0;
+        while (messages_.size() > keep)
+        {
+            stats_->dropped_bytes += audioBytes(messages_.back().data);
+            recycle(std::move(messages_.back().data));
+            messages_.pop_back();
+            ++dropped;
+        }
+        stats_->setQueueDepth(messages_.size());
+        LOG(DEBUG, LOG_TAG) << "Dropped " << dropped << " messages\n";
+    }
+    queue_cv_.notify_all();
+    writeMessage(msg::Type::flush, nullptr, 0);
+}
+
+
+void SnapStream::startSilence(const SampleFormat& format)
+{
+    LOG(INFO, LOG_TAG) << "Start silence: " << format.toString() << "\n";
+    boost::asio::post(io_context_, [this, format]()
+    {
+        if (!running_)
+            return;
+        auto frames = static_cast<size_t>(format.msRate() * kSilencePeriod.count());
+        // all supported sample formats are signed, i.e. silence is 0
+        silence_.assign(frames * format.frameSize(), 0);
+        silence_timer_.expires_at(Clock::instance().now());
+        sendSilence();
+    });
+}
+
+
+void SnapStream::stopSilence()
+{
+    LOG(INFO, LOG_TAG) << "Stop silence\n";
+    boost::asio::post(io_context_, [this]()
+    {
+        silence_.clear();
+        silence_timer_.cancel();
+    });
+}
+
+
+void SnapStream::sendSilence()
+{
+    // Advance the expiry instead of waiting a period from now, to not drift
+    silence_timer_.expires_at(silence_timer_.expiry() + kSilencePeriod);
+    silence_timer_.async_wait([this](const boost::system::error_code& ec)
+    {
+        if (ec || !running_ || silence_.empty())
+            return;
+        write(silence_.data(), static_cast<uint32_t>(silence_.size()));
+        sendSilence();
+    });
+}
+
+
+void SnapStream::pause(bool paused)
+{
+    LOG(INFO, LOG_TAG) << (paused ? "Pause" : "Resume") << "\n";
+    writeMessage(paused ? msg::Type::pause : msg::Type::resume, nullptr, 0);
+    if (protocol_ != Protocol::snapstream)
+        return;
+
+    boost::asio::post(io_context_, [this, paused]()
+    {
+        if (!running_)
+            return;
+        paused_ = paused;
+        if (paused_)
+            keepalive();
+        else
+            keepalive_timer_.cancel();
+    });
+}
+
+
+void SnapStream::keepalive()
+{
+    keepalive_timer_.expires_after(kKeepaliveInterval);
+    keepalive_timer_.async_wait([this](const boost::system::error_code& ec)
+    {
+        if (ec || !running_ || !paused_)
+            return;
+        writeMessage(msg::Type::keepalive, nullptr, 0);
+        keepalive();
+    });
+}
+
+
+void SnapStream::recycle(std::vector<char>&& buffer)
+{
+    if (free_buffers_.size() == free_buffers_.capacity())
+        ++allocations_;
+    free_buffers_.push_back(std::move(buffer));
+}
+
+
+size_t SnapStream::audioBytes(const std::vector<char>& message) const
+{
+    if (protocol_ == Protocol::raw)
+        return message.size();
+
+    msg::Header header;
+    memcpy(&header, message.data(), sizeof(header));
+    if (header.type != static_cast<uint16_t>(msg::Type::audio))
+        return 0;
+    return packing_ ? packing::unpackedSize(header.size, *packing_, header.flags) : header.size;
+}
+
+
+void SnapStream::clearQueue()
+{
+    {
+        std::scoped_lock lock(queue_mutex_);
+        while (!messages_.empty())
+        {
+            stats_->dropped_bytes += audioBytes(messages_.front().data);
+            recycle(std::move(messages_.front().data));
+            messages_.pop_front();
+        }
+        stats_->setQueueDepth(0);
+        sending_ = false;
+        front_written_ = false;
+    }
+    queue_cv_.notify_all();
+}
+
+
+void SnapStream::send()
+{
+    // A send() that was posted before a reconnect can meet the write of the new connection
+    if (writing_)
+        return;
+    std::unique_lock lock(queue_mutex_);
+    if (!running_ || messages_.empty())
+    {
+        sending_ = false;
+        return;
+    }
+    // The message's memory doesn't move, even if the queue grows meanwhile
+    auto buffer = boost::asio::buffer(messages_.front().data);
+    front_written_ = true;
+    lock.unlock();
+
+    auto handler = [this](boost::system::error_code ec, std::size_t length)
+    {
+        writing_ = false;
+        if (!running_)
+            return;
         if (!ec)
         {
             LOG(DEBUG, LOG_TAG) << "Wrote " << length << " bytes\n";
+            stats_->bytes_sent += length;
+            int queued = 0;
+            if (ioctl(socket_.native_handle(), TIOCOUTQ, &queued) == 0)
+                stats_->socket_queue = queued;
+            {
+                std::scoped_lock lock(queue_mutex_);
+                if (front_written_ && !messages_.empty())
+                {
+                    stats_->wire_us.record(Clock::instance().now() - messages_.front().queued);
+                    recycle(std::move(messages_.front().data));
+                    messages_.pop_front();
+                }
+                front_written_ = false;
+                stats_->setQueueDepth(messages_.size());
+            }
+            queue_cv_.notify_all();
+            send();
         }
-        else
+        else if (ec != boost::asio::error::operation_aborted)
         {
             LOG(ERROR, LOG_TAG) << "Failed to write: " << ec << ", message: " << ec.message() << "\n";
             connected_ = false;
+            stats_->connected = false;
+            if (!disconnected_.has_value())
+                disconnected_ = Clock::instance().now();
+            clearQueue();
             socket_.close();
             resolve();
         }
-    });
+    };
+    writing_ = true;
+    boost::asio::async_write(socket_, buffer, makeCustomAllocHandler(write_memory_, std::move(handler)));
 }
 
 void SnapStream::read()
 {
-    boost::asio::async_read(socket_, boost::asio::buffer(buffer_.data(), buffer_.size()),
+    socket_.async_read_some(boost::asio::buffer(buffer_.data(), buffer_.size()),
                             [this](boost::system::error_code ec, std::size_t length)
     {
+        if (!running_)
+            return;
         if (!ec)
         {
             LOG(DEBUG, LOG_TAG) << "Read " << length << " bytes\n";
+            if (data_handler_)
+            {
+                data_handler_(buffer_.data(), length);
+            }
+            else if (message_handler_)
+            {
+                rx_buffer_.insert(rx_buffer_.end(), buffer_.begin(), buffer_.begin() + length);
+                parseMessages();
+            }
             read();
         }
-        else
+        else if (ec != boost::asio::error::operation_aborted)
         {
             LOG(ERROR, LOG_TAG) << "Failed to read: " << ec << ", message: " << ec.message() << "\n";
             connected_ = false;
+            stats_->connected = false;
+            if (!disconnected_.has_value())
+                disconnected_ = Clock::instance().now();
+            // Closing aborts a pending write, whose handler doesn't continue sending
+            clearQueue();
             socket_.close();
             resolve();
         }
     });
 }
+
+
+void SnapStream::parseMessages()
+{
+    size_t pos = 0;
+    while (rx_buffer_.size() - pos >= sizeof(msg::Header))
+    {
+        msg::Header header;
+        memcpy(&header, rx_buffer_.data() + pos, sizeof(header));
+        if (header.size > msg::kMaxPayload)
+        {
+            LOG(ERROR, LOG_TAG) << "Invalid message, type: " << header.type << ", size: " << header.size << "\n";
+            rx_buffer_.clear();
+            return;
+        }
+        if (rx_buffer_.size() - pos < sizeof(header) + header.size)
+            break;
+
+        LOG(DEBUG, LOG_TAG) << "Received message, type: " << header.type << ", size: " << header.size << "\n";
+        message_handler_(header, rx_buffer_.data() + pos + sizeof(header));
+        pos += sizeof(header) + header.size;
+    }
+    rx_buffer_.erase(rx_buffer_.begin(), rx_buffer_.begin() + pos);
+}
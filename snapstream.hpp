@@ -19,15 +19,28 @@
 #pragma once
 
 // local headers
+#include "clock.hpp"
+#include "handler_allocator.hpp"
+#include "protocol.hpp"
+#include "sample_format.hpp"
+#include "stats.hpp"
+#include "thread_settings.hpp"
 #include "uri.hpp"
 
 // 3rd party headers
 #include <atomic>
 #include <boost/asio.hpp>
+#include <boost/circular_buffer.hpp>
 
 // standard headers
 #include <boost/asio/ip/basic_endpoint.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <thread>
+#include <vector>
 
 
 
@@ -36,23 +49,151 @@ using boost::asio::ip::tcp;
 class SnapStream
 {
 public:
-    explicit SnapStream(Uri uri);
+    /// Handler for received data, called from within the stream's thread
+    using DataHandler = std::function<void(const char* data, size_t size)>;
+    /// Handler for received control messages, called from within the stream's thread
+    using MessageHandler = std::function<void(const msg::Header& header, const char* payload)>;
+
+    /// c'tor
+    /// @param uri the server to connect to
+    /// @param protocol raw PCM or framed messages
+    SnapStream(Uri uri, Protocol protocol = Protocol::raw);
+
+    /// Set the @p handler for data received from the server, must be called before start()
+    void setDataHandler(DataHandler handler);
+    /// Set the @p handler for control messages received from the server, must be called before start()
+    /// Received data is parsed into messages, if a message handler is set instead of a data handler.
+    void setMessageHandler(MessageHandler handler);
+    /// Set the scheduling @p settings of the stream's thread, must be called before start()
+    void setThreadSettings(ThreadSettings settings);
+    /// Set the socket's send buffer to @p bytes, to get backpressure early. Must be called before start()
+    void setSendBufferSize(int bytes);
+    /// Pack audio messages of @p format losslessly where the content allows it, see packing::analyze()
+    /// The receiver must understand the audio flags. Must be called before start()
+    void setPacking(const SampleFormat& format);
+
+    /// d'tor
+    ~SnapStream();
+
+    /// Preallocate @p count send buffers of @p size bytes, so that writing doesn't allocate in the steady state
+    /// @param lock lock the buffers into RAM, so that they cannot be paged out
+    void reserve(size_t count, size_t size, bool lock);
+    /// @return the counters of the stream, they are kept if the stream is reused
+    std::shared_ptr<Stats> stats() const;
+    /// @return number of heap allocations on the send path, for checking that the steady state doesn't allocate
+    size_t allocations() const;
 
     void start();
     void stop();
+    /// Queue @p size bytes of @p data for sending. The data is copied, so the caller can reuse the buffer.
     void write(const void* data, uint32_t size);
+    /// Queue a message of @p type with @p size bytes of @p payload, ignored with the raw protocol
+    void writeMessage(msg::Type type, const void* payload, uint32_t size);
+
+    /// Send an end of stream marker and wait until all queued data has been written to the socket
+    /// The kernel's socket send queue is flushed on close, which lingers until the remaining @p timeout is over.
+    /// @return true if drained within @p timeout, false if the connection was lost and queued data was dropped
+    bool drain(std::chrono::milliseconds timeout);
+
+    /// Block until the stream is connected or @p timeout is over
+    /// @return true if connected
+    bool waitForConnection(std::chrono::milliseconds timeout);
+    /// Block until at most @p messages are queued, the connection is lost or @p timeout is over
+    /// @return true if at most @p messages are queued
+    bool waitForQueue(size_t messages, std::chrono::milliseconds timeout);
+
+    /// Drop the queued data and tell the receiver to drop its buffered audio
+    /// A message that is already being written is completed, so that the stream stays intact.
+    void flush();
+
+    /// Send silence in @p format in realtime, to keep the server's stream continuous while no client is attached
+    void startSilence(const SampleFormat& format);
+    /// Stop sending silence
+    void stopSilence();
+
+    /// Tell the receiver to hold its buffer while @p paused, the connection is kept alive meanwhile
+    void pause(bool paused);
 
 private:
     void resolve();
-    void connect(const boost::asio::ip::basic_endpoint<tcp>& ep);
+    /// Connect to the endpoint @p index of @p endpoints, or to the following ones if that fails
+    void connect(std::vector<tcp::endpoint> endpoints, size_t index = 0);
     void read();
+    /// Queue @p size bytes of @p data, prefixed with @p header if not null, for sending
+    /// Audio is packed into header->size bytes if header->flags are set.
+    void enqueue(const msg::Header* header, const void* data, uint32_t size);
+    /// Send the first queued message
+    void send();
+    /// Return @p buffer to the pool, queue_mutex_ must be locked
+    void recycle(std::vector<char>&& buffer);
+    /// @return number of audio bytes in the queued @p message
+    size_t audioBytes(const std::vector<char>& message) const;
+    /// Drop all queued messages
+    void clearQueue();
+    /// Send keepalives while paused
+    void keepalive();
+    /// Send one period of silence when silence_timer_ expires
+    void sendSilence();
+    /// Dispatch the complete messages in rx_buffer_
+    void parseMessages();
 
+    /// handler memory of posting send() and of async_write, must outlive io_context_
+    HandlerMemory post_memory_;
+    HandlerMemory write_memory_;
     std::thread t_;
     boost::asio::io_context io_context_;
     tcp::socket socket_;
-    std::array<char, 100> buffer_;
+    std::array<char, 4096> buffer_;
+    DataHandler data_handler_;
+    MessageHandler message_handler_;
+    ThreadSettings thread_settings_;
+    /// SO_SNDBUF of the socket, the system's default if 0
+    int send_buffer_size_ = 0;
+    /// format of the audio messages, if they are packed
+    std::optional<SampleFormat> packing_;
+    /// received bytes that don't form a complete message yet
+    std::vector<char> rx_buffer_;
     boost::asio::ip::tcp::resolver resolver_;
-    boost::asio::steady_timer timer_;
+    Timer timer_;
+    Timer keepalive_timer_;
+    Timer silence_timer_;
+    /// one period of silence, only accessed from within the io_context
+    std::vector<char> silence_;
+    /// only accessed from within the io_context
+    bool paused_ = false;
+    /// the stream is started, handlers of a stopped stream must not start new operations
+    /// Only accessed from within the io_context, or while its thread is not running.
+    bool running_ = false;
+    /// an async_write is in progress, only accessed from within the io_context
+    bool writing_ = false;
     Uri uri_;
+    Protocol protocol_;
     std::atomic_bool connected_;
+    /// guards messages_, free_buffers_, sending_ and front_written_
+    std::mutex queue_mutex_;
+    /// signaled when a message has been written
+    std::condition_variable queue_cv_;
+    struct Message
+    {
+        std::vector<char> data;
+        /// time when the message was queued
+        Clock::time_point queued;
+    };
+    /// messages to be sent, the first one is being written if front_written_ is true
+    boost::circular_buffer<Message> messages_;
+    /// recycled message buffers
+    std::vector<std::vector<char>> free_buffers_;
+    /// a send() is scheduled or in progress
+    bool sending_ = false;
+    /// an async_write of the first message in messages_ has been started
+    bool front_written_ = false;
+    /// heap allocations of message buffers and of the queue
+    std::atomic<size_t> allocations_{0};
+    /// memory regions locked with mlock
+    std::vector<std::pair<const void*, size_t>> locked_;
+    std::shared_ptr<Stats> stats_;
+    /// number of successful connects, only accessed from within the io_context
+    size_t connects_ = 0;
+    /// time when the connection was lost, only accessed from within the io_context
+    std::optional<Clock::time_point> disconnected_;
 };
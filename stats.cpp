@@ -0,0 +1,121 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "stats.hpp"
+
+// local headers
+#include "aixlog.hpp"
+
+// standard headers
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+
+static constexpr auto LOG_TAG = "Stats";
+
+
+std::string Stats::toString(size_t frame_size) const
+{
+    std::ostringstream os;
+    os << "frames: " << frames << "\n";
+    os << "bytes_sent: " << bytes_sent << "\n";
+    os << "packed_bytes: " << packed_bytes << "\n";
+    os << "dropped_frames: " << dropped_bytes / std::max<size_t>(frame_size, 1) << "\n";
+    os << "underruns: " << underruns << "\n";
+    os << "reconnects: " << reconnects << "\n";
+    os << "late_wakeups: " << late_wakeups << "\n";
+    os << "queue_depth: " << queue_depth << "\n";
+    os << "queue_high_water: " << queue_high_water << "\n";
+    os << "socket_queue: " << socket_queue << "\n";
+    os << "connected: " << connected << "\n";
+    os << latencies();
+    return os.str();
+}
+
+
+std::string Stats::latencies() const
+{
+    std::ostringstream os;
+    os << "transfer_us: " << transfer_us.toString() << "\n";
+    os << "wire_us: " << wire_us.toString() << "\n";
+    os << "pacing_us: " << pacing_us.toString() << "\n";
+    os << "reconnect_us: " << reconnect_us.toString() << "\n";
+    return os.str();
+}
+
+
+StatsFile::StatsFile(std::string path, std::shared_ptr<Stats> stats, size_t frame_size,
+                     std::chrono::milliseconds interval)
+    : path_(std::move(path)), stats_(std::move(stats)), frame_size_(frame_size), interval_(interval)
+{
+    LOG(INFO, LOG_TAG) << "Writing stats to '" << path_ << "' every " << interval_.count() << " ms\n";
+    thread_ = std::thread(
+        [this]()
+    {
+        std::unique_lock lock(mutex_);
+        while (active_)
+        {
+            write();
+            cv_.wait_for(lock, interval_, [this]() { return !active_; });
+        }
+        write();
+    });
+}
+
+
+StatsFile::~StatsFile()
+{
+    {
+        std::scoped_lock lock(mutex_);
+        active_ = false;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+
+void StatsFile::write()
+{
+    // Write a temporary file and rename it, so that readers see either the old or the new content
+    std::string tmp = path_ + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ofstream::out | std::ofstream::trunc);
+        ofs << stats_->toString(frame_size_);
+        if (!ofs)
+        {
+            // Warn once, not every interval
+            if (!failing_)
+                LOG(WARNING, LOG_TAG) << "Failed to write '" << tmp << "': " << strerror(errno) << "\n";
+            failing_ = true;
+            return;
+        }
+    }
+    if (std::rename(tmp.c_str(), path_.c_str()) != 0)
+    {
+        if (!failing_)
+            LOG(WARNING, LOG_TAG) << "Failed to rename '" << tmp << "': " << strerror(errno) << "\n";
+        failing_ = true;
+        return;
+    }
+    failing_ = false;
+}
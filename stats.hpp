@@ -0,0 +1,113 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// local headers
+#include "histogram.hpp"
+
+// standard headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+/// Counters and gauges of a stream, updated lock-free from the audio and the network thread
+struct Stats
+{
+    /// frames accepted from the client (playback) or delivered to the client (capture)
+    std::atomic<uint64_t> frames{0};
+    /// bytes written to the socket
+    std::atomic<uint64_t> bytes_sent{0};
+    /// audio bytes that packing saved on the wire
+    std::atomic<uint64_t> packed_bytes{0};
+    /// audio bytes that were dropped: flushed or lost on disconnect (playback), overflows (capture)
+    std::atomic<uint64_t> dropped_bytes{0};
+    /// capture reads that had to be filled with silence
+    std::atomic<uint64_t> underruns{0};
+    /// connections after the first one
+    std::atomic<uint64_t> reconnects{0};
+    /// Transfer calls that woke up late for the next period
+    std::atomic<uint64_t> late_wakeups{0};
+    /// messages queued for sending
+    std::atomic<uint64_t> queue_depth{0};
+    /// maximum of queue_depth
+    std::atomic<uint64_t> queue_high_water{0};
+    /// bytes in the kernel's socket send queue, sampled after each write
+    std::atomic<uint64_t> socket_queue{0};
+    std::atomic<bool> connected{false};
+
+    /// Latencies in microseconds
+    /// duration of the Transfer calls, without the pacing sleep
+    Histogram transfer_us;
+    /// time from a period entering the plugin until its last byte is written to the socket
+    Histogram wire_us;
+    /// time that Transfer woke up after its deadline
+    Histogram pacing_us;
+    /// time from losing the connection until it is reestablished
+    Histogram reconnect_us;
+
+    /// Set queue_depth to @p depth and update the high-water mark
+    void setQueueDepth(uint64_t depth)
+    {
+        queue_depth.store(depth, std::memory_order_relaxed);
+        if (depth > queue_high_water.load(std::memory_order_relaxed))
+            queue_high_water.store(depth, std::memory_order_relaxed);
+    }
+
+    /// @return "name: value" lines, @p frame_size converts dropped bytes into frames
+    std::string toString(size_t frame_size) const;
+    /// @return the percentiles of the latency histograms, one line per histogram
+    std::string latencies() const;
+};
+
+
+/// Periodically rewrites a file with the current Stats, e.g. under /run
+///
+/// The file is replaced atomically, so readers never see a partially written file.
+class StatsFile
+{
+public:
+    /// @param path the file to write
+    /// @param stats the stats to write
+    /// @param frame_size bytes per frame
+    /// @param interval time between two updates
+    StatsFile(std::string path, std::shared_ptr<Stats> stats, size_t frame_size, std::chrono::milliseconds interval);
+    /// Write the file a last time and stop updating it
+    ~StatsFile();
+
+private:
+    /// Write the stats into path_
+    void write();
+
+    std::string path_;
+    std::shared_ptr<Stats> stats_;
+    size_t frame_size_;
+    std::chrono::milliseconds interval_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool active_ = true;
+    /// the last write failed
+    bool failing_ = false;
+    std::thread thread_;
+};
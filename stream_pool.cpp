@@ -0,0 +1,116 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "stream_pool.hpp"
+
+// local headers
+#include "aixlog.hpp"
+
+// standard headers
+#include <algorithm>
+
+
+static constexpr auto LOG_TAG = "StreamPool";
+
+using namespace std::chrono;
+
+
+StreamPool& StreamPool::instance()
+{
+    static StreamPool pool;
+    return pool;
+}
+
+
+StreamPool::~StreamPool()
+{
+    std::vector<Entry> idle;
+    {
+        std::scoped_lock lock(mutex_);
+        shutdown_ = true;
+        idle.swap(idle_);
+    }
+    cv_.notify_all();
+    if (reaper_.joinable())
+        reaper_.join();
+    for (auto& entry : idle)
+        entry.stream->stop();
+}
+
+
+std::shared_ptr<SnapStream> StreamPool::acquire(const std::string& key)
+{
+    std::scoped_lock lock(mutex_);
+    auto iter = std::find_if(idle_.begin(), idle_.end(), [&key](const Entry& entry) { return entry.key == key; });
+    if (iter == idle_.end())
+        return nullptr;
+
+    LOG(INFO, LOG_TAG) << "Reusing stream: " << key << "\n";
+    auto stream = std::move(iter->stream);
+    idle_.erase(iter);
+    stream->stopSilence();
+    return stream;
+}
+
+
+void StreamPool::release(const std::string& key, std::shared_ptr<SnapStream> stream, milliseconds grace,
+                         const std::optional<SampleFormat>& silence)
+{
+    LOG(INFO, LOG_TAG) << "Keeping stream for " << grace.count() << " ms: " << key << "\n";
+    if (silence.has_value())
+        stream->startSilence(*silence);
+
+    std::unique_lock lock(mutex_);
+    idle_.push_back({key, std::move(stream), steady_clock::now() + grace});
+    if (!reaper_.joinable())
+        reaper_ = std::thread([this]() { reap(); });
+    lock.unlock();
+    cv_.notify_all();
+}
+
+
+void StreamPool::reap()
+{
+    std::unique_lock lock(mutex_);
+    while (!shutdown_)
+    {
+        if (idle_.empty())
+        {
+            cv_.wait(lock);
+            continue;
+        }
+
+        auto next = std::min_element(idle_.begin(), idle_.end(), [](const Entry& lhs, const Entry& rhs)
+        { return lhs.expiry < rhs.expiry; });
+        if (steady_clock::now() < next->expiry)
+        {
+            cv_.wait_until(lock, next->expiry);
+            continue;
+        }
+
+        auto entry = std::move(*next);
+        idle_.erase(next);
+        // Stopping joins the stream's thread, don't block acquire and release meanwhile
+        lock.unlock();
+        LOG(INFO, LOG_TAG) << "Grace period is over, stopping stream: " << entry.key << "\n";
+        entry.stream->stop();
+        entry.stream.reset();
+        lock.lock();
+    }
+}
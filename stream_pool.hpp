@@ -0,0 +1,72 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// local headers
+#include "snapstream.hpp"
+
+// standard headers
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/// Keeps the connections of closed playback devices open for a grace period and hands them to the next open
+///
+/// Players that close and reopen the device per track don't pay for a reconnect and a server rebuffer.
+class StreamPool
+{
+public:
+    /// @return the process wide pool
+    static StreamPool& instance();
+
+    ~StreamPool();
+
+    /// @return the idle stream for @p key, or nullptr if there is none
+    std::shared_ptr<SnapStream> acquire(const std::string& key);
+
+    /// Keep the running @p stream for @p grace, then stop it
+    /// @param silence if set, silence in this format is sent while the stream is idle
+    void release(const std::string& key, std::shared_ptr<SnapStream> stream, std::chrono::milliseconds grace,
+                 const std::optional<SampleFormat>& silence);
+
+private:
+    StreamPool() = default;
+
+    /// Stop the streams whose grace period is over
+    void reap();
+
+    struct Entry
+    {
+        std::string key;
+        std::shared_ptr<SnapStream> stream;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Entry> idle_;
+    std::thread reaper_;
+    bool shutdown_ = false;
+};
@@ -0,0 +1,522 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/// Checks that the audio kernels of every SimdLevel are bit identical to a plain scalar reference
+///
+/// The reference converts one sample at a time, with the same float operations in the same order as the kernels. It
+/// covers every pair of sample encodings, passthrough, gains and downmixes, dither with and without noise shaping,
+/// interleaved and planar sources, and every combination of the packing flags. The odd frame counts leave tails
+/// behind the vectorized loops and cross the mixer's blocks. Levels that the CPU doesn't support are skipped.
+/// Exits with 1 if any output differs.
+
+// local headers
+#include "aixlog.hpp"
+#include "audio_packing.hpp"
+#include "channel_mixer.hpp"
+#include "protocol.hpp"
+#include "sample_format.hpp"
+#include "simd.hpp"
+
+// standard headers
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+/// Frames per mix() call: tails of all vector widths, and more than one of the mixer's blocks
+const std::vector<size_t> kFrames{1, 7, 33, 255, 257, 1031};
+
+/// ChannelMixer's block size, the dither sequence advances per block and output channel
+constexpr size_t kBlockFrames = 256;
+
+/// Number of reported mismatches, the rest is only counted
+constexpr size_t kMaxReports = 20;
+
+
+/// Result of the checks
+struct Counters
+{
+    size_t checks = 0;
+    size_t failures = 0;
+
+    /// Count a check that failed if @p equal is false, and report it as @p what
+    void check(bool equal, const std::string& what)
+    {
+        ++checks;
+        if (equal)
+            return;
+        if (failures++ < kMaxReports)
+            std::cerr << "Mismatch: " << what << "\n";
+    }
+};
+
+
+std::string toString(SampleEncoding encoding)
+{
+    static const std::vector<std::string> names{"s8", "s16le", "s24_3le", "s24_4le", "s32le", "f32le"};
+    return names[static_cast<size_t>(encoding)];
+}
+
+
+/// @return the little endian integer of @p size bytes at @p data, sign extended from @p bits
+int32_t readInt(const uint8_t* data, size_t size, unsigned bits)
+{
+    uint32_t value = 0;
+    for (size_t n = 0; n < size; ++n)
+        value |= static_cast<uint32_t>(data[n]) << (8 * n);
+    return static_cast<int32_t>(value << (32 - bits)) >> (32 - bits);
+}
+
+
+/// Write the lower @p size bytes of @p value little endian to @p data
+void writeInt(int32_t value, size_t size, uint8_t* data)
+{
+    for (size_t n = 0; n < size; ++n)
+        data[n] = static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * n));
+}
+
+
+/// @return the sample at @p data in @p encoding as normalized float
+float decode(SampleEncoding encoding, const uint8_t* data)
+{
+    if (encoding == SampleEncoding::f32le)
+    {
+        float sample;
+        memcpy(&sample, data, sizeof(sample));
+        return sample;
+    }
+    unsigned bits = sampleBits(encoding);
+    float scale = 1.f / static_cast<float>(1u << (bits - 1));
+    return static_cast<float>(readInt(data, sampleSize(encoding), bits)) * scale;
+}
+
+
+/// Settings of a mixer and its scalar reference
+struct MixCase
+{
+    SampleEncoding in;
+    SampleEncoding out;
+    uint16_t in_channels;
+    uint16_t out_channels;
+    /// identity of the default layouts if empty
+    TransferTable ttable;
+    float gain;
+    bool dither;
+    bool noise_shaping;
+};
+
+
+/// Scalar reference of ChannelMixer, one output sample at a time
+class ReferenceMixer
+{
+public:
+    explicit ReferenceMixer(const MixCase& mix) : mix_(mix), error_(mix.out_channels, 0.f)
+    {
+        matrix_.assign(size_t{mix.out_channels} * mix.in_channels, 0.f);
+        if (mix.ttable.empty())
+        {
+            for (size_t c = 0; c < mix.in_channels; ++c)
+                matrix_[c * mix.in_channels + c] = 1.f;
+        }
+        for (const auto& [channels, value] : mix.ttable)
+            matrix_[size_t{channels.second} * mix.in_channels + channels.first] = value;
+        passthrough_ = mix.ttable.empty() && (mix.gain == 1.f) && (mix.in == mix.out);
+        for (auto& value : matrix_)
+            value *= mix.gain;
+
+        bool requantize = (sampleBits(mix.out) < sampleBits(mix.in)) || (mix.in == SampleEncoding::f32le);
+        for (size_t out = 0; out < mix.out_channels; ++out)
+        {
+            size_t sources = 0;
+            for (size_t in = 0; in < mix.in_channels; ++in)
+            {
+                float value = matrix_[out * mix.in_channels + in];
+                sources += (value != 0.f) ? 1 : 0;
+                requantize |= (value != 0.f) && (value != 1.f);
+            }
+            requantize |= (sources > 1);
+        }
+        dither_ = mix.dither && requantize && (mix.out != SampleEncoding::f32le) && (sampleBits(mix.out) <= 16);
+    }
+
+    void mix(const ChannelArea* source, uint8_t* destination, size_t frames)
+    {
+        size_t in_size = sampleSize(mix_.in);
+        size_t out_size = sampleSize(mix_.out);
+        for (size_t offset = 0; offset < frames; offset += kBlockFrames)
+        {
+            size_t count = std::min(kBlockFrames, frames - offset);
+            for (size_t out = 0; out < mix_.out_channels; ++out)
+            {
+                for (size_t n = offset; n < offset + count; ++n)
+                {
+                    uint8_t* sample = destination + (n * mix_.out_channels + out) * out_size;
+                    if (passthrough_)
+                    {
+                        const auto* in = static_cast<const uint8_t*>(source[out].address);
+                        memcpy(sample, in + n * source[out].stride * in_size, in_size);
+                        continue;
+                    }
+                    float acc = 0.f;
+                    for (size_t c = 0; c < mix_.in_channels; ++c)
+                    {
+                        float gain = matrix_[out * mix_.in_channels + c];
+                        if (gain == 0.f)
+                            continue;
+                        const auto* in = static_cast<const uint8_t*>(source[c].address);
+                        acc += gain * decode(mix_.in, in + n * source[c].stride * in_size);
+                    }
+                    encode(acc, noise(seed_ + static_cast<uint32_t>(n - offset)), error_[out], sample);
+                }
+                if (dither_)
+                    seed_ += static_cast<uint32_t>(count);
+            }
+        }
+    }
+
+private:
+    /// TPDF noise of +/-1 LSB for @p index
+    static float noise(uint32_t index)
+    {
+        uint32_t x = index * 0x9e3779b1u;
+        x ^= x >> 15;
+        x *= 0x85ebca77u;
+        x ^= x >> 13;
+        return static_cast<float>(static_cast<int32_t>((x & 0xffffu) + (x >> 16)) - 0xffff) / 65536.f;
+    }
+
+    /// Quantize the normalized @p sample with @p noise and the noise shaping @p error into @p destination
+    void encode(float sample, float noise, float& error, uint8_t* destination) const
+    {
+        if (mix_.out == SampleEncoding::f32le)
+        {
+            memcpy(destination, &sample, sizeof(sample));
+            return;
+        }
+        unsigned bits = sampleBits(mix_.out);
+        float scale = static_cast<float>(1u << (bits - 1));
+        float max = (bits == 32) ? 2147483520.f : scale - 1.f;
+        if (dither_ && mix_.noise_shaping)
+        {
+            float wanted = sample * scale - error;
+            sample = std::floor(wanted + noise + 0.5f);
+            error = sample - wanted;
+        }
+        else if (dither_)
+        {
+            sample = sample * scale + noise;
+        }
+        else
+        {
+            sample *= scale;
+        }
+        sample = (sample < -scale) ? -scale : sample;
+        sample = (sample > max) ? max : sample;
+        writeInt(static_cast<int32_t>(sample + std::copysign(0.5f, sample)), sampleSize(mix_.out), destination);
+    }
+
+    MixCase mix_;
+    std::vector<float> matrix_;
+    bool passthrough_ = false;
+    bool dither_ = false;
+    uint32_t seed_ = 0;
+    std::vector<float> error_;
+};
+
+
+/// @return @p count random samples in @p encoding, floats slightly beyond full scale to cover the clipping
+std::vector<uint8_t> randomSamples(SampleEncoding encoding, size_t count, std::mt19937& random)
+{
+    std::vector<uint8_t> samples(count * sampleSize(encoding));
+    if (encoding == SampleEncoding::f32le)
+    {
+        std::uniform_real_distribution<float> distribution(-1.2f, 1.2f);
+        for (size_t n = 0; n < count; ++n)
+        {
+            float sample = distribution(random);
+            memcpy(samples.data() + n * sizeof(float), &sample, sizeof(float));
+        }
+    }
+    else
+    {
+        for (auto& byte : samples)
+            byte = static_cast<uint8_t>(random());
+        // Full scale values, where rounding and clamping meet
+        if (count > 1)
+        {
+            auto min = static_cast<int32_t>(0xffffffffu << (sampleBits(encoding) - 1));
+            writeInt(min, sampleSize(encoding), samples.data());
+            writeInt(~min, sampleSize(encoding), samples.data() + sampleSize(encoding));
+        }
+    }
+    return samples;
+}
+
+
+/// Mix with each level and with the reference, two calls in a row to cover the dither and noise shaping state
+void checkMix(const MixCase& mix, bool planar, std::mt19937& random, Counters& counters)
+{
+    for (size_t frames : kFrames)
+    {
+        size_t in_size = sampleSize(mix.in);
+        auto samples = randomSamples(mix.in, frames * mix.in_channels, random);
+        // planar: the channels one after another, otherwise interleaved
+        std::vector<ChannelArea> areas(mix.in_channels);
+        for (size_t c = 0; c < mix.in_channels; ++c)
+        {
+            if (planar)
+                areas[c] = {samples.data() + c * frames * in_size, 1};
+            else
+                areas[c] = {samples.data() + c * in_size, mix.in_channels};
+        }
+
+        size_t out_bytes = frames * mix.out_channels * sampleSize(mix.out);
+        ReferenceMixer reference(mix);
+        std::vector<uint8_t> expected(2 * out_bytes);
+        reference.mix(areas.data(), expected.data(), frames);
+        reference.mix(areas.data(), expected.data() + out_bytes, frames);
+
+        for (auto level : {SimdLevel::generic, SimdLevel::avx2, SimdLevel::avx512})
+        {
+            if (simd::force(level) != level)
+                continue;
+            ChannelMixer mixer;
+            ChannelLayout source = ChannelMixer::defaultLayout(mix.in_channels);
+            mixer.configure(mix.in, source, mix.out, ChannelMixer::defaultLayout(mix.out_channels), mix.ttable);
+            mixer.setGain(mix.gain);
+            mixer.setDither(mix.dither);
+            mixer.setNoiseShaping(mix.noise_shaping);
+            std::vector<uint8_t> output(2 * out_bytes);
+            mixer.mix(areas.data(), output.data(), frames);
+            mixer.mix(areas.data(), output.data() + out_bytes, frames);
+            counters.check(output == expected,
+                           "mix " + toString(mix.in) + " -> " + toString(mix.out) + ", channels " +
+                               std::to_string(mix.in_channels) + " -> " + std::to_string(mix.out_channels) +
+                               ", gain " + std::to_string(mix.gain) + ", dither " + std::to_string(mix.dither) +
+                               ", noise shaping " + std::to_string(mix.noise_shaping) + ", planar " +
+                               std::to_string(planar) + ", frames " + std::to_string(frames) + ", simd " +
+                               simd::toString(level));
+        }
+    }
+}
+
+
+void checkMixing(std::mt19937& random, Counters& counters)
+{
+    // 5.1 into stereo and mono into stereo, with gains that need requantization
+    TransferTable downmix{{{0, 0}, 0.5f},  {{1, 1}, 0.5f},  {{2, 0}, 0.35f}, {{3, 1}, 0.35f},
+                          {{4, 0}, 0.35f}, {{4, 1}, 0.35f}, {{5, 0}, 0.1f},  {{5, 1}, 0.1f}};
+    TransferTable upmix{{{0, 0}, 1.f}, {{0, 1}, 1.f}};
+    for (size_t in = 0; in < kSampleEncodings; ++in)
+    {
+        for (size_t out = 0; out < kSampleEncodings; ++out)
+        {
+            auto in_encoding = static_cast<SampleEncoding>(in);
+            auto out_encoding = static_cast<SampleEncoding>(out);
+            std::vector<MixCase> mixes{{in_encoding, out_encoding, 2, 2, {}, 1.f, false, false},
+                                       {in_encoding, out_encoding, 2, 2, {}, 0.37f, false, false},
+                                       {in_encoding, out_encoding, 6, 2, downmix, 1.f, false, false},
+                                       {in_encoding, out_encoding, 1, 2, upmix, 0.8f, false, false}};
+            for (auto mix : mixes)
+            {
+                for (int options = 0; options < 3; ++options)
+                {
+                    mix.dither = (options > 0);
+                    mix.noise_shaping = (options > 1);
+                    for (bool planar : {false, true})
+                        checkMix(mix, planar, random, counters);
+                }
+            }
+        }
+    }
+}
+
+
+/// Reference of packing::analyze
+uint16_t analyzeReference(const std::vector<uint8_t>& data, const SampleFormat& format)
+{
+    size_t size = format.sampleSize();
+    size_t channels = format.channels();
+    size_t frames = data.size() / format.frameSize();
+    bool mono = (channels > 1);
+    for (size_t n = 0; n < frames; ++n)
+    {
+        for (size_t c = 1; c < channels; ++c)
+            mono &= (memcmp(&data[(n * channels + c) * size], &data[n * channels * size], size) == 0);
+    }
+    bool width16 = (size == 4);
+    unsigned shift = format.bits() - 16u;
+    for (size_t n = 0; width16 && (n < frames * channels); ++n)
+    {
+        int32_t value = readInt(&data[n * size], size, 32);
+        width16 = (static_cast<int32_t>(static_cast<uint32_t>(static_cast<int16_t>(value >> shift)) << shift) == value);
+    }
+    return (mono ? msg::kFlagMono : 0) | (width16 ? msg::kFlagWidth16 : 0);
+}
+
+
+/// Reference of packing::pack
+std::vector<uint8_t> packReference(const std::vector<uint8_t>& data, const SampleFormat& format, uint16_t flags)
+{
+    size_t size = format.sampleSize();
+    size_t channels = format.channels();
+    size_t step = ((flags & msg::kFlagMono) != 0) ? channels : 1;
+    bool width16 = ((flags & msg::kFlagWidth16) != 0);
+    size_t packed_size = width16 ? 2 : size;
+    std::vector<uint8_t> packed;
+    for (size_t n = 0; n < data.size() / size; n += step)
+    {
+        int32_t value = readInt(&data[n * size], size, 8 * size);
+        if (width16)
+            value = static_cast<int16_t>(static_cast<uint32_t>(value) >> (format.bits() - 16u));
+        packed.resize(packed.size() + packed_size);
+        writeInt(value, packed_size, &packed[packed.size() - packed_size]);
+    }
+    return packed;
+}
+
+
+/// Reference of packing::unpack
+std::vector<uint8_t> unpackReference(const std::vector<uint8_t>& packed, const SampleFormat& format, uint16_t flags)
+{
+    size_t size = format.sampleSize();
+    size_t copies = ((flags & msg::kFlagMono) != 0) ? format.channels() : 1;
+    bool width16 = ((flags & msg::kFlagWidth16) != 0);
+    size_t packed_size = width16 ? 2 : size;
+    std::vector<uint8_t> data;
+    for (size_t n = 0; n < packed.size() / packed_size; ++n)
+    {
+        int32_t value = readInt(&packed[n * packed_size], packed_size, 8 * packed_size);
+        if (width16)
+            value = static_cast<int32_t>(static_cast<uint32_t>(value) << (format.bits() - 16u));
+        for (size_t c = 0; c < copies; ++c)
+        {
+            data.resize(data.size() + size);
+            writeInt(value, size, &data[data.size() - size]);
+        }
+    }
+    return data;
+}
+
+
+/// @return @p frames frames of random audio in @p format, optionally identical in all channels and with only 16
+/// significant bits. With @p break_last, the last frame breaks that, so that the analysis must look at the tail.
+std::vector<uint8_t> packingSamples(const SampleFormat& format, size_t frames, bool mono, bool narrow,
+                                    bool break_last, std::mt19937& random)
+{
+    size_t size = format.sampleSize();
+    unsigned shift = (size == 4) ? format.bits() - 16u : 0u;
+    auto sample = [&]()
+    {
+        auto value = static_cast<int32_t>(random());
+        if (narrow && (size == 4))
+            value = static_cast<int32_t>(static_cast<uint32_t>(static_cast<int16_t>(value)) << shift);
+        return value;
+    };
+    std::vector<uint8_t> data(frames * format.frameSize());
+    for (size_t n = 0; n < frames; ++n)
+    {
+        int32_t first = sample();
+        for (size_t c = 0; c < format.channels(); ++c)
+            writeInt(((c == 0) || mono) ? first : sample(), size, &data[(n * format.channels() + c) * size]);
+    }
+    if (break_last)
+    {
+        // A low bit breaks the width, the last channel breaks mono
+        data[data.size() - size] ^= 1;
+    }
+    return data;
+}
+
+
+void checkPacking(std::mt19937& random, Counters& counters)
+{
+    for (const auto* name : {"48000:8:2", "48000:16:2", "48000:16:6", "48000:24_3:2", "48000:24:2", "48000:24:1",
+                             "48000:32:2", "48000:32:6", "48000:float:2"})
+    {
+        SampleFormat format(name);
+        for (size_t frames : kFrames)
+        {
+            for (int content = 0; content < 8; ++content)
+            {
+                auto data = packingSamples(format, frames, (content & 1) != 0, (content & 2) != 0, (content & 4) != 0,
+                                           random);
+                auto analyzed = analyzeReference(data, format);
+                for (auto level : {SimdLevel::generic, SimdLevel::avx2, SimdLevel::avx512})
+                {
+                    if (simd::force(level) != level)
+                        continue;
+                    std::string what = std::string(name) + ", frames " + std::to_string(frames) + ", content " +
+                                       std::to_string(content) + ", simd " + simd::toString(level);
+                    counters.check(packing::analyze(data.data(), data.size(), format) == analyzed,
+                                   "analyze " + what);
+
+                    // Every combination of the flags, the width only exists for 32 bit samples
+                    for (uint16_t flags = 0; flags <= (msg::kFlagMono | msg::kFlagWidth16); ++flags)
+                    {
+                        if (((flags & msg::kFlagWidth16) != 0) && (format.sampleSize() != 4))
+                            continue;
+                        auto expected = packReference(data, format, flags);
+                        std::vector<uint8_t> packed(packing::packedSize(data.size(), format, flags));
+                        packing::pack(data.data(), data.size(), format, flags, packed.data());
+                        counters.check(packed == expected, "pack flags " + std::to_string(flags) + " " + what);
+
+                        auto unpacked_expected = unpackReference(expected, format, flags);
+                        std::vector<uint8_t> unpacked(packing::unpackedSize(expected.size(), format, flags));
+                        packing::unpack(expected.data(), expected.size(), format, flags, unpacked.data());
+                        counters.check(unpacked == unpacked_expected,
+                                       "unpack flags " + std::to_string(flags) + " " + what);
+                        // Lossless if the analysis allows the flags
+                        if ((flags & ~analyzed) == 0)
+                            counters.check(unpacked == data, "round trip flags " + std::to_string(flags) + " " + what);
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+
+int main()
+{
+    AixLog::Log::init<AixLog::SinkCerr>(AixLog::Severity::warning);
+
+    std::cout << "SIMD levels:";
+    for (auto level : {SimdLevel::generic, SimdLevel::avx2, SimdLevel::avx512})
+        std::cout << " " << simd::toString(level) << (simd::force(level) == level ? "" : " (skipped)");
+    std::cout << "\n";
+
+    std::mt19937 random(1);
+    Counters counters;
+    checkMixing(random, counters);
+    checkPacking(random, counters);
+    simd::reset();
+
+    std::cout << counters.checks << " checks, " << counters.failures << " failures\n";
+    return (counters.failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "thread_settings.hpp"
+
+// local headers
+#include "aixlog.hpp"
+#include "string_utils.hpp"
+
+// standard headers
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+static constexpr auto LOG_TAG = "ThreadSettings";
+
+
+bool ThreadSettings::parseCpuList(const std::string& cpus)
+{
+    cpu_affinity.clear();
+    for (const auto& range : utils::string::split(cpus, ','))
+    {
+        std::string last;
+        std::string first = utils::string::split_left(utils::string::trim_copy(range), '-', last);
+        try
+        {
+            int from = std::stoi(first);
+            int to = last.empty() ? from : std::stoi(last);
+            if ((from < 0) || (to < from) || (to >= CPU_SETSIZE))
+                return false;
+            for (int cpu = from; cpu <= to; ++cpu)
+                cpu_affinity.push_back(cpu);
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+    return !cpu_affinity.empty();
+}
+
+
+void ThreadSettings::apply(const std::string& name) const
+{
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+    if (!cpu_affinity.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpu_affinity)
+            CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+            LOG(WARNING, LOG_TAG) << "Failed to set the CPU affinity of " << name << ": " << strerror(err) << "\n";
+        else
+            LOG(INFO, LOG_TAG) << "CPU affinity of " << name << ": " << utils::string::container_to_string(cpu_affinity)
+                               << "\n";
+    }
+
+    bool realtime = false;
+    if (rtprio.has_value())
+    {
+        sched_param param{};
+        param.sched_priority = *rtprio;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err == 0)
+        {
+            realtime = true;
+            LOG(INFO, LOG_TAG) << "Realtime priority of " << name << ": " << *rtprio << "\n";
+        }
+        else
+        {
+            rlimit limit{};
+            getrlimit(RLIMIT_RTPRIO, &limit);
+            LOG(WARNING, LOG_TAG) << "Failed to set realtime priority " << *rtprio << " for " << name << ": "
+                                  << strerror(err) << ", RLIMIT_RTPRIO: " << limit.rlim_cur
+                                  << (nice.has_value() ? ", falling back to nice" : "") << "\n";
+        }
+    }
+
+    // The nice value doesn't matter for SCHED_FIFO threads
+    if (nice.has_value() && !realtime)
+    {
+        // On Linux the nice value is per thread
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), *nice) != 0)
+            LOG(WARNING, LOG_TAG) << "Failed to set nice " << *nice << " for " << name << ": " << strerror(errno)
+                                  << ", RLIMIT_NICE might be too low\n";
+        else
+            LOG(INFO, LOG_TAG) << "Nice value of " << name << ": " << *nice << "\n";
+    }
+}
+
+
+std::string ThreadSettings::toString() const
+{
+    std::string result = rtprio.has_value() ? std::to_string(*rtprio) : "";
+    result += ":" + (nice.has_value() ? std::to_string(*nice) : "") + ":";
+    for (size_t n = 0; n < cpu_affinity.size(); ++n)
+        result += (n == 0 ? "" : ",") + std::to_string(cpu_affinity[n]);
+    return result;
+}
@@ -0,0 +1,47 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// standard headers
+#include <optional>
+#include <string>
+#include <vector>
+
+
+/// Scheduling settings of the streaming threads
+struct ThreadSettings
+{
+    /// SCHED_FIFO priority [1..99]
+    std::optional<int> rtprio;
+    /// nice value [-20..19], also used as fallback if the realtime priority cannot be set
+    std::optional<int> nice;
+    /// CPUs the thread may run on, all if empty
+    std::vector<int> cpu_affinity;
+
+    /// Parse a CPU list like "0,2-3" into @p cpu_affinity
+    /// @return false if @p cpus is not a valid CPU list
+    bool parseCpuList(const std::string& cpus);
+
+    /// Apply the settings to the calling thread @p name
+    /// Settings that cannot be applied, e.g. because of missing permissions (RLIMIT_RTPRIO), are logged and skipped.
+    void apply(const std::string& name) const;
+
+    /// @return the settings as "rtprio:nice:cpus", unset values are empty
+    std::string toString() const;
+};
@@ -0,0 +1,94 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+// prototype/interface header file
+#include "volume.hpp"
+
+// local headers
+#include "aixlog.hpp"
+
+// standard headers
+#include <algorithm>
+#include <map>
+#include <unistd.h>
+
+
+static constexpr auto LOG_TAG = "Volume";
+
+
+Volume::Volume(uint16_t percent) : percent_(std::min<uint16_t>(percent, 100)), muted_(false)
+{
+}
+
+
+std::shared_ptr<Volume> Volume::get(const std::string& device, uint16_t initial)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<Volume>> volumes;
+
+    std::scoped_lock lock(mutex);
+    auto volume = volumes[device].lock();
+    if (!volume)
+    {
+        LOG(DEBUG, LOG_TAG) << "Create volume for device: " << device << ", volume: " << initial << "\n";
+        volume = std::make_shared<Volume>(initial);
+        volumes[device] = volume;
+    }
+    return volume;
+}
+
+
+void Volume::setPercent(uint16_t percent)
+{
+    percent = std::min<uint16_t>(percent, 100);
+    if (percent_.exchange(percent) != percent)
+        notify();
+}
+
+
+void Volume::setMuted(bool muted)
+{
+    if (muted_.exchange(muted) != muted)
+        notify();
+}
+
+
+void Volume::addListener(int fd)
+{
+    std::scoped_lock lock(mutex_);
+    listeners_.push_back(fd);
+}
+
+
+void Volume::removeListener(int fd)
+{
+    std::scoped_lock lock(mutex_);
+    listeners_.erase(std::remove(listeners_.begin(), listeners_.end(), fd), listeners_.end());
+}
+
+
+void Volume::notify()
+{
+    std::scoped_lock lock(mutex_);
+    uint64_t one = 1;
+    for (int fd : listeners_)
+    {
+        if (write(fd, &one, sizeof(one)) < 0)
+            LOG(DEBUG, LOG_TAG) << "Failed to signal listener " << fd << "\n";
+    }
+}
@@ -0,0 +1,83 @@
+/***
+    This file is part of alsa-snapcast
+    Copyright (C) 2025  Johannes Pohl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#pragma once
+
+// standard headers
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/// Volume of a stream, set by the server, the configuration or the ctl plugin and read by the audio thread
+///
+/// PCM and CTL instances of the same device share one Volume within the process, see get().
+class Volume
+{
+public:
+    /// c'tor
+    explicit Volume(uint16_t percent = 100);
+
+    /// @return the volume shared by all instances of @p device, created on first use
+    /// @param initial volume in percent if the volume is created, an existing volume is not changed
+    static std::shared_ptr<Volume> get(const std::string& device, uint16_t initial = 100);
+
+    /// Set the volume to @p percent [0..100]
+    void setPercent(uint16_t percent);
+
+    /// @return volume in percent
+    uint16_t percent() const
+    {
+        return percent_;
+    }
+
+    /// Mute or unmute
+    void setMuted(bool muted);
+
+    /// @return true if muted
+    bool muted() const
+    {
+        return muted_;
+    }
+
+    /// @return linear gain for the current volume, using a cubic curve to approximate the perceived loudness
+    float gain() const
+    {
+        if (muted_)
+            return 0.f;
+        float volume = static_cast<float>(percent_) / 100.f;
+        return volume * volume * volume;
+    }
+
+    /// Signal the eventfd @p fd whenever the volume or the mute state changes
+    void addListener(int fd);
+    /// Stop signaling @p fd
+    void removeListener(int fd);
+
+private:
+    /// Signal all listeners
+    void notify();
+
+    std::atomic<uint16_t> percent_;
+    std::atomic_bool muted_;
+    std::mutex mutex_;
+    std::vector<int> listeners_;
+};